@@ -0,0 +1,186 @@
+#include "ParserHarness.hpp"
+#include "../includes/HttpRequest.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+/* ************************************************************************** */
+/*                                  Corpus                                    */
+/* ************************************************************************** */
+
+// Value of the JSON string field 'key' in 'line'; false if absent
+static bool jsonString(const std::string &line, const std::string &key, std::string &out)
+{
+	size_t pos = line.find("\"" + key + "\"");
+	if (pos == std::string::npos)
+		return false;
+	pos = line.find('"', line.find(':', pos) + 1);
+	if (pos == std::string::npos)
+		throw std::runtime_error("bad string field '" + key + "'");
+	out.clear();
+	for (++pos; pos < line.size() && line[pos] != '"'; ++pos)
+	{
+		if (line[pos] != '\\')
+		{
+			out += line[pos];
+			continue;
+		}
+		char c = line[++pos];
+		if (c == 'n')
+			out += '\n';
+		else if (c == 'r')
+			out += '\r';
+		else if (c == 't')
+			out += '\t';
+		else if (c == 'u')
+		{
+			// Only \u0000-\u00ff: one code point per byte
+			out += static_cast<char>(std::strtoul(line.substr(pos + 1, 4).c_str(), NULL, 16));
+			pos += 4;
+		}
+		else
+			out += c; // \" \\ \/
+	}
+	if (pos >= line.size())
+		throw std::runtime_error("unterminated string field '" + key + "'");
+	return true;
+}
+
+std::vector<CorpusCase> loadCorpus(const std::string &path)
+{
+	std::ifstream file(path.c_str());
+	if (!file.is_open())
+		throw std::runtime_error("cannot open corpus '" + path + "'");
+
+	std::vector<CorpusCase> corpus;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty())
+			continue;
+		CorpusCase entry;
+		if (!jsonString(line, "name", entry.name) || !jsonString(line, "raw", entry.input))
+			throw std::runtime_error("corpus line without \"name\" and \"raw\": " + line.substr(0, 60));
+		size_t pad = line.find("\"pad\"");
+		if (pad != std::string::npos)
+			entry.input.append(std::strtoul(line.c_str() + line.find(':', pad) + 1, NULL, 10), 'x');
+		corpus.push_back(entry);
+	}
+	return corpus;
+}
+
+/* ************************************************************************** */
+/*                                  Feeding                                   */
+/* ************************************************************************** */
+
+// Printable form of request bytes for the dump
+static std::string escape(const std::string &bytes)
+{
+	std::string out;
+	char hex[8];
+	for (size_t i = 0; i < bytes.size(); ++i)
+	{
+		unsigned char c = bytes[i];
+		if (c >= 0x20 && c < 0x7f && c != '\\')
+			out += c;
+		else
+		{
+			std::snprintf(hex, sizeof(hex), "\\x%02x", c);
+			out += hex;
+		}
+	}
+	return out;
+}
+
+// FNV-1a, so bodies are compared without being printed
+static unsigned long long hashBytes(const std::string &bytes)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < bytes.size(); ++i)
+		hash = (hash ^ static_cast<unsigned char>(bytes[i])) * 1099511628211ULL;
+	return hash;
+}
+
+// Every "Name:" that starts a line of the input: the header names worth querying
+static std::vector<std::string> headerNames(const std::string &input)
+{
+	std::set<std::string> names;
+	size_t start = 0;
+	while (start < input.size())
+	{
+		size_t end = input.find('\n', start);
+		if (end == std::string::npos)
+			end = input.size();
+		size_t colon = input.find(':', start);
+		if (colon != std::string::npos && colon < end && colon > start && colon - start < 64)
+			names.insert(input.substr(start, colon - start));
+		start = end + 1;
+	}
+	return std::vector<std::string>(names.begin(), names.end());
+}
+
+static void dumpRequest(const HttpRequest &request, const std::vector<std::string> &names, std::string &dump)
+{
+	char line[128];
+	std::snprintf(line, sizeof(line), "error=%d body=%lu:%016llx", request.getErrorCode(),
+				  (unsigned long)request.getBodySize(), hashBytes(request.getBody()));
+	dump += line;
+	dump += " method=" + escape(request.getMethod()) + " path=" + escape(request.getPath()) +
+			" version=" + escape(request.getVersion()) + " headers={";
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		std::string value = request.getHeader(names[i]);
+		if (!value.empty())
+			dump += escape(names[i]) + "=" + escape(value) + ";";
+	}
+	dump += "}\n";
+}
+
+size_t feedParser(const std::string &input, const std::vector<size_t> &splits, std::string *dump)
+{
+	static const size_t NO_LIMIT = 1UL << 30; // Keeps bodies in memory
+
+	std::vector<std::string> names;
+	if (dump)
+		names = headerNames(input);
+	HttpRequest request;
+	size_t requests = 0;
+	size_t pos = 0;
+	bool failed = false;
+	for (size_t piece = 0; piece <= splits.size() && !failed; ++piece)
+	{
+		size_t end = piece < splits.size() ? std::min(splits[piece], input.size()) : input.size();
+		if (end < pos)
+			continue;
+		request.parse(input.data() + pos, end - pos);
+		pos = end;
+
+		// Same order as Webserver::processPipeline()
+		while (true)
+		{
+			if (request.needsBodyLimits())
+			{
+				request.setBodyLimits(NO_LIMIT, NO_LIMIT, "/tmp");
+				request.parse("", 0);
+			}
+			if (!request.isFinished())
+				break;
+			++requests;
+			if (dump)
+				dumpRequest(request, names, *dump);
+			if (request.getErrorCode())
+			{
+				failed = true; // The server answers and closes
+				break;
+			}
+			request.reset();
+			request.parse("", 0);
+		}
+	}
+	if (dump && !failed && request.hasStarted())
+		*dump += "incomplete\n";
+	return requests;
+}
@@ -0,0 +1,35 @@
+#ifndef PARSERHARNESS_HPP
+#define PARSERHARNESS_HPP
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief One request corpus entry, shared by parser_bench and parser_fuzz.
+ *
+ * The corpus is JSON lines: {"name": "...", "raw": "...", "pad": N}.
+ * "raw" holds the bytes as a JSON string (\u00XX for any byte), and the
+ * optional "pad" appends N 'x' bytes so large bodies stay out of the file.
+ */
+struct CorpusCase {
+    std::string name;
+    std::string input;
+};
+
+// Throws std::runtime_error on an unreadable file or a malformed line
+std::vector<CorpusCase> loadCorpus(const std::string& path);
+
+/**
+ * @brief Feed 'input' to HttpRequest the way the server does.
+ *
+ * The input is delivered in pieces ending at the given offsets (the rest
+ * follows in a last piece), body limits are set as soon as the headers are
+ * in, and pipelined requests are parsed after each reset(). Unless 'dump'
+ * is NULL, it receives one canonical line per request, so two ways of
+ * parsing the same bytes can be compared byte for byte.
+ *
+ * @return The number of complete requests.
+ */
+size_t feedParser(const std::string& input, const std::vector<size_t>& splits, std::string* dump);
+
+#endif
@@ -0,0 +1,40 @@
+#!/usr/bin/python3
+"""Compare two "make bench" reports and flag regressions.
+
+Usage: compare.py BASELINE.json CURRENT.json [threshold_percent]
+
+A scenario regresses when its throughput drops, or its p99 latency grows,
+by more than the threshold (10% by default). Exits 1 on any regression.
+"""
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        return {r["name"]: r for r in json.load(f)["results"]}
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+    base, cur = load(sys.argv[1]), load(sys.argv[2])
+    threshold = float(sys.argv[3]) if len(sys.argv) > 3 else 10.0
+    regressed = False
+    print("%-24s %12s %12s %8s %10s %10s %8s" % ("scenario", "rps before", "rps after", "delta", "p99 before", "p99 after", "delta"))
+    for name, after in cur.items():
+        before = base.get(name)
+        if before is None:
+            continue
+        rps = (after["rps"] - before["rps"]) * 100.0 / max(before["rps"], 1e-9)
+        p99_before, p99_after = before["latency_ms"]["p99"], after["latency_ms"]["p99"]
+        p99 = (p99_after - p99_before) * 100.0 / max(p99_before, 1e-9)
+        flag = rps < -threshold or p99 > threshold
+        regressed = regressed or flag
+        print("%-24s %12.1f %12.1f %+7.1f%% %10.3f %10.3f %+7.1f%%%s" % (
+            name, before["rps"], after["rps"], rps, p99_before, p99_after, p99, "  REGRESSION" if flag else ""))
+    sys.exit(1 if regressed else 0)
+
+
+if __name__ == "__main__":
+    main()
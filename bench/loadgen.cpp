@@ -0,0 +1,458 @@
+/**
+ * @file loadgen.cpp
+ * @brief Closed-loop HTTP/1.1 load generator used by "make bench".
+ *
+ * Keeps N keep-alive connections busy with up to P pipelined requests each,
+ * cycling through a request mix, and prints one JSON object with the
+ * throughput and the latency percentiles of the responses received.
+ *
+ * Usage: loadgen [-a host:port] [-c connections] [-p pipeline] [-d seconds]
+ *                [-n name] -r "METHOD PATH [BODY_BYTES] [chunked]" [-r ...]
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static unsigned long long nowUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* ************************************************************************** */
+/*                                 Requests                                   */
+/* ************************************************************************** */
+
+// "POST /uploads/x 65536 chunked" -> serialized request, built once
+static std::string buildRequest(const std::string &spec, const std::string &host)
+{
+	std::istringstream ss(spec);
+	std::string method, path, flag;
+	size_t body_bytes = 0;
+	ss >> method >> path >> body_bytes >> flag;
+	if (method.empty() || path.empty())
+	{
+		std::fprintf(stderr, "loadgen: bad request spec '%s'\n", spec.c_str());
+		std::exit(2);
+	}
+
+	std::string request = method + " " + path + " HTTP/1.1\r\nHost: " + host + "\r\nUser-Agent: webserv-loadgen\r\n";
+	std::string body(body_bytes, 'x');
+	if (body_bytes == 0)
+		return request + "\r\n";
+	if (flag != "chunked")
+	{
+		std::ostringstream length;
+		length << body_bytes;
+		return request + "Content-Length: " + length.str() + "\r\n\r\n" + body;
+	}
+
+	// Chunked upload in 16 KiB chunks
+	request += "Transfer-Encoding: chunked\r\n\r\n";
+	for (size_t pos = 0; pos < body.size(); pos += 16384)
+	{
+		size_t len = std::min((size_t)16384, body.size() - pos);
+		char size_line[32];
+		std::snprintf(size_line, sizeof(size_line), "%lx\r\n", (unsigned long)len);
+		request += size_line + body.substr(pos, len) + "\r\n";
+	}
+	return request + "0\r\n\r\n";
+}
+
+/* ************************************************************************** */
+/*                                 Responses                                  */
+/* ************************************************************************** */
+
+// Incremental response reader: head, then a length, chunked or until-close body
+struct ResponseParser
+{
+	enum State
+	{
+		HEAD,
+		BODY_LENGTH,
+		CHUNK_SIZE,
+		CHUNK_DATA,
+		CHUNK_TRAILER,
+		BODY_UNTIL_CLOSE
+	};
+
+	State state;
+	int status;
+	bool close_after;
+	size_t remaining;
+
+	ResponseParser() : state(HEAD), status(0), close_after(false), remaining(0) {}
+
+	// Consume 'in' from 'pos'; true when a whole response was read
+	bool parse(const std::string &in, size_t &pos)
+	{
+		while (true)
+		{
+			if (state == HEAD)
+			{
+				size_t end = in.find("\r\n\r\n", pos);
+				if (end == std::string::npos)
+					return false;
+				parseHead(in.substr(pos, end - pos));
+				pos = end + 4;
+				if (state == HEAD)
+					return true; // No body
+			}
+			else if (state == BODY_LENGTH)
+			{
+				size_t take = std::min(remaining, in.size() - pos);
+				pos += take;
+				remaining -= take;
+				if (remaining > 0)
+					return false;
+				state = HEAD;
+				return true;
+			}
+			else if (state == CHUNK_SIZE)
+			{
+				size_t end = in.find("\r\n", pos);
+				if (end == std::string::npos)
+					return false;
+				remaining = std::strtoul(in.c_str() + pos, NULL, 16);
+				pos = end + 2;
+				state = remaining ? CHUNK_DATA : CHUNK_TRAILER;
+				if (remaining)
+					remaining += 2; // CRLF after the data
+			}
+			else if (state == CHUNK_DATA)
+			{
+				size_t take = std::min(remaining, in.size() - pos);
+				pos += take;
+				remaining -= take;
+				if (remaining > 0)
+					return false;
+				state = CHUNK_SIZE;
+			}
+			else if (state == CHUNK_TRAILER)
+			{
+				size_t end = in.find("\r\n", pos);
+				if (end == std::string::npos)
+					return false;
+				bool last = (end == pos);
+				pos = end + 2;
+				if (last)
+				{
+					state = HEAD;
+					return true;
+				}
+			}
+			else
+			{
+				pos = in.size(); // Ends with the connection
+				return false;
+			}
+		}
+	}
+
+	void parseHead(const std::string &head)
+	{
+		status = std::atoi(head.c_str() + 9);
+		close_after = false;
+		bool has_length = false;
+		bool chunked = false;
+		size_t line = head.find("\r\n");
+		while (line != std::string::npos)
+		{
+			size_t start = line + 2;
+			line = head.find("\r\n", start);
+			std::string field = head.substr(start, line == std::string::npos ? std::string::npos : line - start);
+			for (size_t i = 0; i < field.size() && field[i] != ':'; ++i)
+				field[i] = std::tolower((unsigned char)field[i]);
+			if (field.compare(0, 15, "content-length:") == 0)
+			{
+				has_length = true;
+				remaining = std::strtoul(field.c_str() + 15, NULL, 10);
+			}
+			else if (field.compare(0, 18, "transfer-encoding:") == 0 && field.find("chunked") != std::string::npos)
+				chunked = true;
+			else if (field.compare(0, 11, "connection:") == 0 && field.find("close") != std::string::npos)
+				close_after = true;
+		}
+		if (chunked)
+			state = CHUNK_SIZE;
+		else if (has_length && remaining > 0)
+			state = BODY_LENGTH;
+		else if (!has_length && status != 204 && status != 304)
+		{
+			state = BODY_UNTIL_CLOSE;
+			close_after = true;
+		}
+		else
+			state = HEAD;
+	}
+};
+
+/* ************************************************************************** */
+/*                                Connections                                 */
+/* ************************************************************************** */
+
+struct Connection
+{
+	int fd;
+	std::string out;
+	size_t out_pos;
+	std::string in;
+	size_t in_pos;
+	std::deque<unsigned long long> sent_at; // One per request in flight
+	ResponseParser parser;
+	size_t next; // Index in the request mix
+
+	Connection() : fd(-1), out_pos(0), in_pos(0), next(0) {}
+};
+
+struct Stats
+{
+	std::vector<unsigned> latencies_us;
+	unsigned long long responses[6]; // Unknown, 1xx .. 5xx
+	unsigned long long errors;       // Connects, resets, truncated responses
+	unsigned long long bytes_read;
+
+	Stats() : errors(0), bytes_read(0) { std::memset(responses, 0, sizeof(responses)); }
+};
+
+static struct sockaddr_in g_addr;
+
+static bool openConnection(Connection &conn, Stats &stats)
+{
+	conn.fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (conn.fd < 0 || connect(conn.fd, (struct sockaddr *)&g_addr, sizeof(g_addr)) < 0)
+	{
+		if (conn.fd >= 0)
+			close(conn.fd);
+		conn.fd = -1;
+		++stats.errors;
+		return false;
+	}
+	int one = 1;
+	setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	fcntl(conn.fd, F_SETFL, O_NONBLOCK);
+	conn.out.clear();
+	conn.out_pos = 0;
+	conn.in.clear();
+	conn.in_pos = 0;
+	conn.sent_at.clear();
+	conn.parser = ResponseParser();
+	return true;
+}
+
+static void closeConnection(Connection &conn, Stats &stats, bool expected)
+{
+	if (!expected && !conn.sent_at.empty())
+		++stats.errors; // Requests lost in flight
+	close(conn.fd);
+	conn.fd = -1;
+}
+
+static void usage()
+{
+	std::fprintf(stderr, "usage: loadgen [-a host:port] [-c connections] [-p pipeline] [-d seconds] [-n name]\n"
+						 "               -r \"METHOD PATH [BODY_BYTES] [chunked]\" [-r ...]\n");
+	std::exit(2);
+}
+
+static unsigned percentile(const std::vector<unsigned> &sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+int main(int argc, char **argv)
+{
+	std::string address = "127.0.0.1:8080";
+	std::string name = "bench";
+	size_t connections = 50;
+	size_t pipeline = 1;
+	double duration = 5;
+	std::vector<std::string> specs;
+
+	// 1. Options
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string opt = argv[i];
+		if (i + 1 >= argc)
+			usage();
+		const char *val = argv[++i];
+		if (opt == "-a")
+			address = val;
+		else if (opt == "-c")
+			connections = std::strtoul(val, NULL, 10);
+		else if (opt == "-p")
+			pipeline = std::strtoul(val, NULL, 10);
+		else if (opt == "-d")
+			duration = std::strtod(val, NULL);
+		else if (opt == "-n")
+			name = val;
+		else if (opt == "-r")
+			specs.push_back(val);
+		else
+			usage();
+	}
+	size_t colon = address.rfind(':');
+	if (specs.empty() || connections == 0 || pipeline == 0 || duration <= 0 || colon == std::string::npos)
+		usage();
+	std::memset(&g_addr, 0, sizeof(g_addr));
+	g_addr.sin_family = AF_INET;
+	g_addr.sin_port = htons(std::atoi(address.c_str() + colon + 1));
+	if (inet_pton(AF_INET, address.substr(0, colon).c_str(), &g_addr.sin_addr) != 1)
+		usage();
+	signal(SIGPIPE, SIG_IGN);
+
+	std::vector<std::string> mix;
+	for (size_t i = 0; i < specs.size(); ++i)
+		mix.push_back(buildRequest(specs[i], address));
+
+	// 2. Connections, each starting at a different point of the mix
+	Stats stats;
+	std::vector<Connection> conns(connections);
+	for (size_t i = 0; i < conns.size(); ++i)
+	{
+		conns[i].next = i % mix.size();
+		openConnection(conns[i], stats);
+	}
+
+	// 3. Closed loop until the deadline: refill, write, read
+	unsigned long long start = nowUs();
+	unsigned long long deadline = start + (unsigned long long)(duration * 1000000);
+	std::vector<struct pollfd> fds(conns.size());
+	char buffer[65536];
+	while (nowUs() < deadline)
+	{
+		for (size_t i = 0; i < conns.size(); ++i)
+		{
+			Connection &conn = conns[i];
+			if (conn.fd == -1 && !openConnection(conn, stats))
+			{
+				fds[i].fd = -1;
+				continue;
+			}
+			while (conn.sent_at.size() < pipeline && !conn.parser.close_after)
+			{
+				conn.out += mix[conn.next];
+				conn.next = (conn.next + 1) % mix.size();
+				conn.sent_at.push_back(0); // Stamped once its last byte is written
+			}
+			fds[i].fd = conn.fd;
+			fds[i].events = POLLIN | (conn.out_pos < conn.out.size() ? POLLOUT : 0);
+			fds[i].revents = 0;
+		}
+
+		long left_ms = (long)((deadline - nowUs()) / 1000);
+		if (poll(&fds[0], fds.size(), left_ms > 100 ? 100 : left_ms) < 0 && errno != EINTR)
+		{
+			perror("poll");
+			return 1;
+		}
+		unsigned long long now = nowUs();
+
+		for (size_t i = 0; i < conns.size(); ++i)
+		{
+			Connection &conn = conns[i];
+			if (conn.fd == -1 || fds[i].revents == 0)
+				continue;
+
+			// Write: requests are timed from the moment they are fully sent
+			if (fds[i].revents & POLLOUT)
+			{
+				ssize_t n = send(conn.fd, conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos, 0);
+				if (n < 0 && errno != EAGAIN)
+				{
+					closeConnection(conn, stats, false);
+					continue;
+				}
+				if (n > 0)
+					conn.out_pos += n;
+				if (conn.out_pos == conn.out.size())
+				{
+					for (size_t k = 0; k < conn.sent_at.size(); ++k)
+						if (conn.sent_at[k] == 0)
+							conn.sent_at[k] = now;
+					conn.out.clear();
+					conn.out_pos = 0;
+				}
+			}
+
+			// Read: complete as many responses as arrived
+			if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+			{
+				ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+				if (n <= 0)
+				{
+					if (n < 0 && errno == EAGAIN)
+						continue;
+					bool until_close = conn.parser.state == ResponseParser::BODY_UNTIL_CLOSE;
+					if (until_close && !conn.sent_at.empty())
+					{
+						stats.latencies_us.push_back(now - conn.sent_at.front());
+						++stats.responses[conn.parser.status / 100 <= 5 ? conn.parser.status / 100 : 0];
+						conn.sent_at.pop_front();
+					}
+					closeConnection(conn, stats, conn.sent_at.empty() || until_close);
+					continue;
+				}
+				stats.bytes_read += n;
+				conn.in.append(buffer, n);
+				while (!conn.sent_at.empty() && conn.parser.parse(conn.in, conn.in_pos))
+				{
+					unsigned long long sent = conn.sent_at.front() ? conn.sent_at.front() : now;
+					stats.latencies_us.push_back(now - sent);
+					++stats.responses[conn.parser.status / 100 <= 5 ? conn.parser.status / 100 : 0];
+					conn.sent_at.pop_front();
+				}
+				if (conn.in_pos == conn.in.size())
+				{
+					conn.in.clear();
+					conn.in_pos = 0;
+				}
+				if (conn.parser.close_after && conn.parser.state == ResponseParser::HEAD)
+					closeConnection(conn, stats, conn.sent_at.empty());
+			}
+		}
+	}
+	double elapsed = (nowUs() - start) / 1e6;
+	for (size_t i = 0; i < conns.size(); ++i)
+		if (conns[i].fd != -1)
+			close(conns[i].fd);
+
+	// 4. Report
+	std::vector<unsigned> &lat = stats.latencies_us;
+	std::sort(lat.begin(), lat.end());
+	double mean = 0;
+	for (size_t i = 0; i < lat.size(); ++i)
+		mean += lat[i];
+	mean = lat.empty() ? 0 : mean / lat.size();
+	std::printf("{\"name\": \"%s\", \"connections\": %lu, \"pipeline\": %lu, \"duration_s\": %.2f, "
+				"\"requests\": %lu, \"rps\": %.1f, \"mb_per_s\": %.2f, "
+				"\"latency_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f}, "
+				"\"status\": {\"1xx\": %llu, \"2xx\": %llu, \"3xx\": %llu, \"4xx\": %llu, \"5xx\": %llu, "
+				"\"other\": %llu}, \"errors\": %llu}\n",
+				name.c_str(), (unsigned long)connections, (unsigned long)pipeline, elapsed, (unsigned long)lat.size(),
+				lat.size() / elapsed, stats.bytes_read / elapsed / (1024 * 1024), mean / 1000,
+				percentile(lat, 0.50) / 1000.0, percentile(lat, 0.99) / 1000.0, percentile(lat, 0.999) / 1000.0,
+				(lat.empty() ? 0 : lat.back()) / 1000.0, stats.responses[1], stats.responses[2], stats.responses[3],
+				stats.responses[4], stats.responses[5], stats.responses[0], stats.errors);
+	return 0;
+}
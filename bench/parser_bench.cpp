@@ -0,0 +1,216 @@
+/**
+ * @file parser_bench.cpp
+ * @brief HttpRequest::parse throughput and byte-for-byte regression check.
+ *
+ * Usage: parser_bench [-t seconds] CORPUS...             benchmark, JSON lines
+ *        parser_bench --dump CORPUS...                   canonical parse output
+ *        parser_bench --check EXPECTED CORPUS...         verify against a dump
+ *        parser_bench --export DIR CORPUS...             one file per case
+ *        --scanner NAME with any of them forces a Scanner variant
+ *
+ * The benchmark parses every case whole, in 1460-byte segments and, for
+ * cases up to 64 KiB, one byte at a time. --check compares the dump of
+ * every case fed whole, and split at every byte boundary, with EXPECTED.
+ */
+
+#include "ParserHarness.hpp"
+#include "../includes/Scanner.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+static const size_t SEGMENT = 1460;         // One TCP segment
+static const size_t BYTEWISE_MAX = 64 * 1024; // Larger cases are too slow a byte at a time
+
+static double nowSeconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static std::vector<size_t> everyN(size_t size, size_t step)
+{
+	std::vector<size_t> splits;
+	for (size_t pos = step; pos < size; pos += step)
+		splits.push_back(pos);
+	return splits;
+}
+
+static void bench(const CorpusCase &entry, const char *mode, const std::vector<size_t> &splits, double seconds)
+{
+	// Repeat until the time budget is spent, checking the clock every batch
+	size_t iterations = 0;
+	size_t requests = 0;
+	size_t batch = 1;
+	double start = nowSeconds();
+	double elapsed = 0;
+	while (elapsed < seconds)
+	{
+		for (size_t i = 0; i < batch; ++i)
+			requests += feedParser(entry.input, splits, NULL);
+		iterations += batch;
+		if (batch < 1024)
+			batch *= 2;
+		elapsed = nowSeconds() - start;
+	}
+	std::printf("{\"name\": \"%s\", \"mode\": \"%s\", \"scanner\": \"%s\", \"bytes\": %lu, "
+				"\"iterations\": %lu, \"mb_per_s\": %.2f, \"requests_per_s\": %.0f, \"ns_per_request\": %.1f}\n",
+				entry.name.c_str(), mode, Scanner::implementation(), (unsigned long)entry.input.size(), (unsigned long)iterations,
+				entry.input.size() * iterations / elapsed / (1024 * 1024), requests / elapsed,
+				requests ? elapsed * 1e9 / requests : 0.0);
+}
+
+static std::string dumpCase(const CorpusCase &entry, const std::vector<size_t> &splits)
+{
+	std::string dump;
+	feedParser(entry.input, splits, &dump);
+	return dump;
+}
+
+// Whole-input dump of every case, each line prefixed with the case name
+static std::string dumpCorpus(const std::vector<CorpusCase> &corpus)
+{
+	std::string out;
+	for (size_t i = 0; i < corpus.size(); ++i)
+	{
+		std::istringstream lines(dumpCase(corpus[i], std::vector<size_t>()));
+		std::string line;
+		while (std::getline(lines, line))
+			out += corpus[i].name + ": " + line + "\n";
+	}
+	return out;
+}
+
+static int check(const std::vector<CorpusCase> &corpus, const std::string &expected_path)
+{
+	// 1. Whole inputs against the recorded dump
+	std::ifstream file(expected_path.c_str());
+	if (!file.is_open())
+		throw std::runtime_error("cannot open '" + expected_path + "'");
+	std::stringstream expected;
+	expected << file.rdbuf();
+	std::string actual = dumpCorpus(corpus);
+	if (actual != expected.str())
+	{
+		std::cerr << "parser_bench: output differs from " << expected_path << "; run --dump and diff" << std::endl;
+		return 1;
+	}
+
+	// 2. Every two-piece split of every case parses like the whole input
+	int failures = 0;
+	for (size_t i = 0; i < corpus.size(); ++i)
+	{
+		const CorpusCase &entry = corpus[i];
+		std::string whole = dumpCase(entry, std::vector<size_t>());
+		size_t limit = entry.input.size() > BYTEWISE_MAX ? 0 : entry.input.size();
+		for (size_t split = 1; split < limit; ++split)
+		{
+			if (dumpCase(entry, std::vector<size_t>(1, split)) != whole)
+			{
+				std::cerr << "parser_bench: " << entry.name << " parses differently when split at byte " << split
+						  << std::endl;
+				++failures;
+				break;
+			}
+		}
+		if (dumpCase(entry, everyN(entry.input.size(), limit ? 1 : SEGMENT)) != whole)
+		{
+			std::cerr << "parser_bench: " << entry.name << " parses differently when fed in small pieces" << std::endl;
+			++failures;
+		}
+	}
+	std::cerr << "parser_bench: " << corpus.size() << " cases, " << failures << " split mismatches" << std::endl;
+	return failures ? 1 : 0;
+}
+
+static void exportCases(const std::vector<CorpusCase> &corpus, const std::string &dir)
+{
+	for (size_t i = 0; i < corpus.size(); ++i)
+	{
+		std::string path = dir + "/" + corpus[i].name;
+		std::ofstream out(path.c_str(), std::ios::binary);
+		out.write(corpus[i].input.data(), corpus[i].input.size());
+		if (!out.good())
+			throw std::runtime_error("cannot write '" + path + "'");
+	}
+}
+
+static void usage()
+{
+	std::cerr << "usage: parser_bench [--scanner NAME] [-t seconds | --dump | --check EXPECTED | --export DIR] "
+				 "CORPUS..."
+			  << std::endl;
+	std::exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	std::string mode = "bench";
+	std::string arg;
+	double seconds = 0.2;
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-'; ++i)
+	{
+		std::string opt = argv[i];
+		if (opt == "--dump")
+			mode = "dump";
+		else if ((opt == "--check" || opt == "--export" || opt == "-t") && i + 1 < argc)
+		{
+			mode = opt == "-t" ? mode : opt.substr(2);
+			arg = argv[++i];
+			if (opt == "-t")
+				seconds = std::strtod(arg.c_str(), NULL);
+		}
+		else if (opt == "--scanner" && i + 1 < argc)
+		{
+			if (!Scanner::useImplementation(argv[++i]))
+			{
+				std::cerr << "parser_bench: scanner " << argv[i] << " is not available" << std::endl;
+				return 2;
+			}
+		}
+		else
+			usage();
+	}
+	if (i == argc)
+		usage();
+
+	try
+	{
+		std::vector<CorpusCase> corpus;
+		for (; i < argc; ++i)
+		{
+			std::vector<CorpusCase> file = loadCorpus(argv[i]);
+			corpus.insert(corpus.end(), file.begin(), file.end());
+		}
+
+		if (mode == "dump")
+			std::cout << dumpCorpus(corpus);
+		else if (mode == "check")
+			return check(corpus, arg);
+		else if (mode == "export")
+			exportCases(corpus, arg);
+		else
+		{
+			for (size_t c = 0; c < corpus.size(); ++c)
+			{
+				bench(corpus[c], "whole", std::vector<size_t>(), seconds);
+				bench(corpus[c], "segments", everyN(corpus[c].input.size(), SEGMENT), seconds);
+				if (corpus[c].input.size() <= BYTEWISE_MAX)
+					bench(corpus[c], "bytewise", everyN(corpus[c].input.size(), 1), seconds);
+			}
+		}
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << "parser_bench: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,152 @@
+/**
+ * @file parser_fuzz.cpp
+ * @brief Fuzz target for HttpRequest::parse.
+ *
+ * Each input is parsed whole and split in two at a boundary picked from
+ * its first bytes; both must produce the same requests, with every Scanner
+ * variant the CPU supports, and sanitizers catch any out-of-bounds slice.
+ * Two builds:
+ *
+ *   libFuzzer:  clang++ -fsanitize=fuzzer,address bench/parser_fuzz.cpp \
+ *                 bench/ParserHarness.cpp srcs/Scanner.cpp srcs/HttpRequest.cpp \
+ *                 srcs/Log.cpp
+ *               (seed it from "parser_bench --export DIR CORPUS")
+ *   standalone: make fuzz, which defines PARSER_FUZZ_MAIN and mutates the
+ *               corpus cases with a small built-in mutator
+ */
+
+#include "ParserHarness.hpp"
+#include "../includes/Scanner.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <stdint.h>
+
+static const char *const SCANNERS[] = {"portable", "sse2", "avx2"};
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	std::string input(reinterpret_cast<const char *>(data), size);
+	std::string whole;
+	const char *reference = Scanner::implementation();
+	feedParser(input, std::vector<size_t>(), &whole);
+
+	for (size_t i = 0; i < sizeof(SCANNERS) / sizeof(SCANNERS[0]); ++i)
+	{
+		if (!Scanner::useImplementation(SCANNERS[i]))
+			continue;
+		std::string other;
+		feedParser(input, std::vector<size_t>(), &other);
+		if (other != whole)
+		{
+			std::fprintf(stderr, "parser_fuzz: %s and %s scanners disagree\n%s:\n%s%s:\n%s", reference,
+						 SCANNERS[i], reference, whole.c_str(), SCANNERS[i], other.c_str());
+			std::abort();
+		}
+	}
+	Scanner::useImplementation(reference);
+
+	size_t split = size > 2 ? (data[0] | (data[1] << 8)) % size : 0;
+	std::string halves;
+	feedParser(input, std::vector<size_t>(1, split), &halves);
+	if (halves != whole)
+	{
+		std::fprintf(stderr, "parser_fuzz: split at %lu changes the result\nwhole:\n%ssplit:\n%s",
+					 (unsigned long)split, whole.c_str(), halves.c_str());
+		std::abort();
+	}
+	return 0;
+}
+
+#ifdef PARSER_FUZZ_MAIN
+
+// Bytes that steer the parser into its interesting branches
+static const char *const TOKENS[] = {"\r\n", "\r\n\r\n", ":", " ", "0\r\n\r\n", "Content-Length: ",
+									 "Transfer-Encoding: chunked\r\n", "ffffffffffffffff", "\n", ";"};
+
+static unsigned long g_seed = 1;
+
+static size_t randomBelow(size_t n)
+{
+	g_seed = g_seed * 6364136223846793005UL + 1442695040888963407UL;
+	return n ? (size_t)(g_seed >> 33) % n : 0;
+}
+
+static void mutate(std::string &input)
+{
+	size_t edits = 1 + randomBelow(4);
+	for (size_t e = 0; e < edits; ++e)
+	{
+		size_t pos = randomBelow(input.size() + 1);
+		switch (randomBelow(5))
+		{
+		case 0: // Flip a byte
+			if (pos < input.size())
+				input[pos] = static_cast<char>(randomBelow(256));
+			break;
+		case 1: // Drop a range
+			input.erase(pos, randomBelow(16));
+			break;
+		case 2: // Insert a token
+			input.insert(pos, TOKENS[randomBelow(sizeof(TOKENS) / sizeof(TOKENS[0]))]);
+			break;
+		case 3: // Duplicate a range
+			if (pos < input.size())
+				input.insert(pos, input.substr(pos, randomBelow(64)));
+			break;
+		default: // Truncate
+			input.resize(pos);
+			break;
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "usage: parser_fuzz CORPUS... [runs]" << std::endl;
+		return 2;
+	}
+	unsigned long runs = 100000;
+	std::vector<CorpusCase> corpus;
+	try
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			char *end;
+			unsigned long n = std::strtoul(argv[i], &end, 10);
+			if (*end == '\0')
+				runs = n;
+			else
+			{
+				std::vector<CorpusCase> file = loadCorpus(argv[i]);
+				corpus.insert(corpus.end(), file.begin(), file.end());
+			}
+		}
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << "parser_fuzz: " << e.what() << std::endl;
+		return 1;
+	}
+	if (corpus.empty())
+		return 1;
+
+	// 1. The seeds themselves, then 2. mutations of them (large seeds are skipped)
+	for (size_t i = 0; i < corpus.size(); ++i)
+		LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(corpus[i].input.data()), corpus[i].input.size());
+	for (unsigned long run = 0; run < runs; ++run)
+	{
+		std::string input = corpus[randomBelow(corpus.size())].input;
+		if (input.size() > 16384)
+			continue;
+		mutate(input);
+		LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+	}
+	std::cerr << "parser_fuzz: " << runs << " runs over " << corpus.size() << " seeds, no failures" << std::endl;
+	return 0;
+}
+
+#endif
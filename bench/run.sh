@@ -0,0 +1,85 @@
+#!/bin/sh
+# Runs the load scenarios against a freshly started webserv and prints one
+# JSON report. Invoked by "make bench"; knobs come from the environment:
+#   BENCH_PORT (8181)  BENCH_DURATION seconds per scenario (5)
+#   BENCH_CONNECTIONS (50)  BENCH_OUT report file (bench_output.json)
+#   BASELINE earlier report to compare against (bench/compare.py)
+
+set -e
+cd "$(dirname "$0")/.."
+REPO=$(pwd)
+PORT=${BENCH_PORT:-8181}
+DURATION=${BENCH_DURATION:-5}
+CONNS=${BENCH_CONNECTIONS:-50}
+OUT=${BENCH_OUT:-bench_output.json}
+WORK=$(mktemp -d /tmp/webserv-bench.XXXXXX)
+
+# 1. Document root: small and large files, a directory to list, an upload dir
+mkdir -p "$WORK/www/listing" "$WORK/www/uploads"
+head -c 1024 /dev/zero | tr '\0' 'a' > "$WORK/www/small.html"
+head -c 8388608 /dev/urandom > "$WORK/www/large.bin"
+i=0
+while [ $i -lt 200 ]; do
+    : > "$WORK/www/listing/file_$i.txt"
+    i=$((i + 1))
+done
+
+cat > "$WORK/bench.conf" <<CONF
+server {
+    listen $PORT;
+    host 127.0.0.1;
+    root $WORK/www;
+    client_max_body_size 100000000;
+    # Pipelined requests in flight when a connection is recycled count as errors
+    keepalive_requests 100000000;
+
+    location / {
+        allow_methods GET POST;
+        autoindex on;
+    }
+
+    location /cgi-bin/ {
+        root $REPO;
+        allow_methods GET POST;
+        cgi_ext .py;
+    }
+}
+CONF
+
+# 2. Server, stopped with SIGTERM so it shuts down cleanly
+./webserv "$WORK/bench.conf" > "$WORK/webserv.log" 2>&1 &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null; wait $SERVER 2>/dev/null; rm -rf "$WORK"' EXIT INT TERM
+tries=0
+until ./bench/loadgen -a 127.0.0.1:$PORT -c 1 -d 0.1 -n probe -r "GET /small.html" 2>/dev/null | grep -q '"2xx": [1-9]'; do
+    tries=$((tries + 1))
+    if [ $tries -gt 50 ] || ! kill -0 $SERVER 2>/dev/null; then
+        echo "bench: webserv did not start:" >&2
+        cat "$WORK/webserv.log" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+# 3. Scenarios: name, connections, pipeline depth, request
+scenario() {
+    ./bench/loadgen -a 127.0.0.1:$PORT -n "$1" -c "$2" -p "$3" -d "$DURATION" -r "$4"
+}
+{
+    echo "{\"version\": \"$(git describe --always --dirty 2>/dev/null || echo unknown)\","
+    echo " \"date\": \"$(date -u +%Y-%m-%dT%H:%M:%SZ)\","
+    echo " \"results\": ["
+    scenario small_static "$CONNS" 1 "GET /small.html";                      echo ","
+    scenario small_static_pipelined "$CONNS" 16 "GET /small.html";           echo ","
+    scenario large_static 8 1 "GET /large.bin";                              echo ","
+    scenario not_found "$CONNS" 1 "GET /missing.html";                       echo ","
+    scenario autoindex "$CONNS" 1 "GET /listing/";                           echo ","
+    scenario chunked_upload 8 1 "POST /uploads/upload.bin 65536 chunked";    echo ","
+    scenario cgi 8 1 "GET /cgi-bin/test.py"
+    echo "]}"
+} > "$OUT"
+cat "$OUT"
+
+if [ -n "$BASELINE" ]; then
+    python3 bench/compare.py "$BASELINE" "$OUT"
+fi
@@ -0,0 +1,96 @@
+#ifndef ACCESSLOG_HPP
+#define ACCESSLOG_HPP
+
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+
+// Request fields kept on a response until its access log line is written
+struct AccessEntry {
+    struct in_addr remote_addr;
+    std::string method;
+    std::string uri;
+    std::string version;
+    std::string host;
+    int status;
+    unsigned long long bytes_sent;
+    unsigned long long duration_ms;
+
+    AccessEntry() : status(0), bytes_sent(0), duration_ms(0) { remote_addr.s_addr = 0; }
+};
+
+/**
+ * @brief log_format compiled once into literals and variables.
+ *
+ * Variables: $remote_addr $time_local $request $method $uri $status
+ * $bytes_sent $request_time $host.
+ */
+class LogFormat {
+public:
+    static const char* const DEFAULT; // Common log format with the duration
+
+    // Throws std::runtime_error on an unknown variable
+    void compile(const std::string& format);
+    void format(const AccessEntry& entry, std::string& line) const;
+
+private:
+    enum Variable {
+        VAR_LITERAL,
+        VAR_REMOTE_ADDR,
+        VAR_TIME_LOCAL,
+        VAR_REQUEST,
+        VAR_METHOD,
+        VAR_URI,
+        VAR_STATUS,
+        VAR_BYTES_SENT,
+        VAR_REQUEST_TIME,
+        VAR_HOST
+    };
+
+    struct Part {
+        Variable variable;
+        std::string literal;
+    };
+
+    std::vector<Part> _parts;
+};
+
+/**
+ * @brief One access_log file written through a fixed ring buffer.
+ *
+ * Lines are only copied into the ring on the request path. The event loop
+ * writes it out in one writev() once it would overflow or when the oldest
+ * buffered line is 'flush_ms' old, so disk writes are batched and never
+ * flushed per line. Flushes end on a line boundary, so O_APPEND writes
+ * of several workers do not interleave within lines.
+ */
+class AccessLog {
+public:
+    AccessLog(const std::string& path, const std::string& format, size_t buffer_size,
+              unsigned long flush_ms); // Throws if the file cannot be opened
+    ~AccessLog();
+
+    const std::string& path() const { return _path; }
+    void log(const AccessEntry& entry, unsigned long long now_ms);
+
+    // Milliseconds until the next time-triggered flush, -1 when the ring is empty
+    long untilFlush(unsigned long long now_ms) const;
+    void flushIfDue(unsigned long long now_ms);
+    void flush();
+
+private:
+    std::string _path;
+    int _fd;
+    LogFormat _format;
+    std::vector<char> _ring;
+    size_t _head; // Oldest buffered byte
+    size_t _used;
+    unsigned long _flush_ms;
+    unsigned long long _oldest_ms; // When the ring stopped being empty
+    std::string _line;             // Reused formatting buffer
+
+    AccessLog(const AccessLog&);
+    AccessLog& operator=(const AccessLog&);
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <string>
+#include <cstddef>
+
+// Content codings a response can be sent with, one bit each
+enum ContentCoding {
+    CODING_GZIP = 1 << 0,
+    CODING_BR   = 1 << 1
+};
+
+/**
+ * @brief Accept-Encoding negotiation and gzip compression of static files.
+ *
+ * Precompressed .br/.gz sidecars need nothing but this negotiation. On the
+ * fly compression needs zlib, built in with "make ZLIB=1" (WEBSERV_ZLIB).
+ */
+class Compression {
+public:
+    // Codings with a non-zero q-value, '*' counting for those not listed
+    static unsigned acceptedCodings(const std::string& accept_encoding);
+    static bool isCompressible(const std::string& mime_type);
+
+    static bool gzipAvailable();
+    // false if zlib is missing, fails, or the result would not be smaller
+    static bool gzip(const char* data, size_t len, std::string& out);
+};
+
+#endif
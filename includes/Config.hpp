@@ -7,6 +7,8 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include "Log.hpp"
+#include "AccessLog.hpp"
 
 struct LocationConfig {
     std::string path;
@@ -17,8 +19,15 @@ struct LocationConfig {
     std::string return_path; // For redirections
     int return_code;         // e.g. 301, 302
     std::vector<std::string> cgi_ext; // NEW: Stores extensions like ".php"
+    std::string fastcgi_pass;         // "unix:/path" or "host:port", replaces fork/execve
+    bool gzip;        // Compress text files on the fly (needs a zlib build)
+    bool gzip_static; // Serve fresh .br/.gz sidecars to clients that accept them
+    bool has_expires; // Send Cache-Control on static responses
+    long expires;     // max-age in seconds, -1 for no-cache
+    bool stub_status; // Answer with the server metrics instead of files
 
-    LocationConfig() : autoindex(false), return_code(0) {}
+    LocationConfig() : autoindex(false), return_code(0), gzip(false), gzip_static(false), has_expires(false),
+                       expires(0), stub_status(false) {}
 };
 
 struct ServerConfig {
@@ -28,17 +37,67 @@ struct ServerConfig {
     std::vector<std::string> server_names;
     std::map<int, std::string> error_pages;
     unsigned long client_max_body_size; // In bytes
+    unsigned long client_body_buffer_size; // Larger bodies are spooled to disk
+    std::string client_body_temp_path;
     std::vector<LocationConfig> locations;
 
-    // Default: 80, 0.0.0.0, 1MB max body
-    ServerConfig() : port(80), host("0.0.0.0"), root("./"), client_max_body_size(1024 * 1024) {}
+    // Timeouts in seconds
+    int keepalive_timeout;     // Idle connection between requests
+    int client_header_timeout; // Whole request line + headers
+    int client_body_timeout;   // Between two reads of the body
+    int send_timeout;          // Between two writes of the response
+    int cgi_timeout;           // Between two reads of CGI or FastCGI output
+    int keepalive_requests;    // Requests answered on one connection before it is closed
+
+    // Access log, written in batches (empty path = off)
+    std::string access_log;
+    unsigned long access_log_buffer; // Ring size in bytes
+    int access_log_flush;            // Max age of a buffered line in seconds
+
+    // Default: 80, 0.0.0.0, 1MB max body, 64KB in memory, spooled to /tmp
+    ServerConfig() : port(80), host("0.0.0.0"), root("./"), client_max_body_size(1024 * 1024),
+                     client_body_buffer_size(64 * 1024), client_body_temp_path("/tmp"),
+                     keepalive_timeout(75), client_header_timeout(60), client_body_timeout(60),
+                     send_timeout(60), cgi_timeout(3), keepalive_requests(1000), access_log_buffer(64 * 1024), access_log_flush(1) {}
+};
+
+// Directives that live outside of any server block
+struct GlobalConfig {
+    int worker_processes; // 1 = single process, no master
+    int pipeline_depth;   // Requests per connection answered ahead of the client
+    int fastcgi_connections; // Persistent connections per FastCGI backend
+    int worker_connections;  // Open client connections per worker before accepting pauses
+
+    // In-memory static response cache (0 bytes = disabled)
+    unsigned long static_cache_size;
+    unsigned long static_cache_max_file;
+    int static_cache_valid; // Seconds between stat() revalidations
+    unsigned long gzip_cache_size; // Budget of on-the-fly gzip responses (0 = no on-the-fly gzip)
+
+    // Open descriptors and stat() results of served paths (0 entries = disabled)
+    unsigned long open_file_cache;
+    int open_file_cache_valid; // Seconds between stat() revalidations
+    bool open_file_cache_errors; // Also remember paths that do not exist
+
+    LogLevel log_level;     // Diagnostics on stderr
+    std::string log_format; // Access log line, see LogFormat
+
+    GlobalConfig() : worker_processes(1), pipeline_depth(16), fastcgi_connections(8), worker_connections(1024),
+                     static_cache_size(0), static_cache_max_file(1024 * 1024), static_cache_valid(1),
+                     gzip_cache_size(16 * 1024 * 1024),
+                     open_file_cache(0), open_file_cache_valid(60), open_file_cache_errors(false),
+                     log_level(LEVEL_WARN), log_format(LogFormat::DEFAULT) {}
 };
 
 class ConfigParser {
 public:
     std::vector<ServerConfig> parse(const std::string& filename);
+    const GlobalConfig& getGlobalConfig() const;
 
 private:
+    GlobalConfig _global;
+
+    void parseGlobalDirective(const std::string& token, std::stringstream& ss);
     void parseServerBlock(std::stringstream& ss, ServerConfig& config);
     void parseLocationBlock(std::stringstream& ss, LocationConfig& location);
     bool isValidMethod(const std::string& method);
@@ -0,0 +1,88 @@
+#ifndef CONNECTIONTABLE_HPP
+#define CONNECTIONTABLE_HPP
+
+#include "Config.hpp"
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <netinet/in.h>
+
+struct Client;
+
+/**
+ * @brief Client connections indexed by fd.
+ *
+ * A lookup is one vector access. Client objects come from a free list and
+ * go back to it on close, so keep-alive churn does not reallocate. Request
+ * input buffers are pooled apart from them, in 4K, 16K and 64K size classes
+ * with a bounded free list each: a connection gets the smallest buffer
+ * available when it is opened or restored, and hands it back to the class
+ * its capacity fits. Larger buffers are freed, so one large request does
+ * not pin its memory in the pool.
+ *
+ * An idle keep-alive connection with nothing buffered is parked: its
+ * Client returns to the pool and the slot keeps only what is needed to
+ * resume it, a few dozen bytes. Indexing a parked fd restores a Client.
+ * Parked connections are also kept in parking order, so the server can
+ * close the longest idle ones first when it runs out of room.
+ */
+class ConnectionTable {
+public:
+    static const size_t POOL_SIZE = 256;              // Free Clients kept around
+    static const size_t POOLED_BUFFER_MAX = 16 * 1024; // Larger header and body buffers are freed
+    static const size_t BUFFER_CLASSES = 3;           // Request buffer size classes, see the .cpp
+
+    ConnectionTable();
+    ~ConnectionTable();
+
+    Client& open(int fd); // Blank Client for a new connection
+    Client& operator[](int fd)
+    {
+        Slot& slot = _slots[fd];
+        return slot.client ? *slot.client : restore(fd);
+    }
+    bool contains(int fd) const { return (size_t)fd < _slots.size() && _slots[fd].open; }
+    bool isParked(int fd) const { return contains(fd) && !_slots[fd].client; }
+    size_t size() const { return _open; } // Open connections, parked ones included
+    int oldestParked() const { return _parked_head; } // -1 if none
+
+    // Park the connection if it is idle; false if it is still busy
+    bool park(int fd);
+    void close(int fd);
+
+private:
+    // A parked connection: the Client fields that outlive a request
+    struct IdleConnection {
+        int listening_port;
+        struct in_addr remote_addr;
+        const ServerConfig* server;
+        int requests;
+        int prev, next; // Neighbours in parking order, -1 at the ends
+    };
+
+    struct Slot {
+        bool open;
+        Client* client; // NULL while parked
+        IdleConnection idle;
+
+        Slot() : open(false), client(NULL) {}
+    };
+
+    std::vector<Slot> _slots; // Indexed by fd
+    std::vector<Client*> _pool;
+    std::vector<std::string> _buffers[BUFFER_CLASSES]; // Free request buffers per size class
+    size_t _open;
+    int _parked_head, _parked_tail; // Longest and most recently parked
+
+    Client* take();
+    void recycle(Client* client);
+    void lendBuffer(std::string& buffer);
+    void returnBuffer(std::string& buffer);
+    Client& restore(int fd);
+    void unlinkParked(int fd);
+
+    ConnectionTable(const ConnectionTable&);
+    ConnectionTable& operator=(const ConnectionTable&);
+};
+
+#endif
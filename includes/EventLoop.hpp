@@ -0,0 +1,84 @@
+#ifndef EVENTLOOP_HPP
+#define EVENTLOOP_HPP
+
+#include <vector>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+// Interest / readiness flags shared by every backend
+enum EventFlags {
+    EVENT_READ  = 1,
+    EVENT_WRITE = 2,
+    EVENT_ERROR = 4, // Hang-up or error (reported, never requested)
+    EVENT_EDGE  = 8  // Edge-triggered delivery (honored by epoll only)
+};
+
+struct Event {
+    int fd;
+    int events; // Combination of EventFlags
+};
+
+/**
+ * @brief Readiness notification interface used by the Webserver loop.
+ *
+ * Backends only report fds that are ready, so the cost of one wakeup
+ * scales with the number of ready events instead of open connections.
+ */
+class EventLoop {
+public:
+    virtual ~EventLoop() {}
+
+    virtual bool add(int fd, int events) = 0;
+    virtual bool modify(int fd, int events) = 0;
+    virtual void remove(int fd) = 0;
+
+    // Blocks up to timeout_ms (-1 = forever), fills 'ready', returns count or -1
+    virtual int wait(std::vector<Event>& ready, int timeout_ms) = 0;
+    virtual const char* name() const = 0;
+
+    // epoll on Linux, poll() everywhere else or if epoll is unavailable
+    static EventLoop* create();
+};
+
+class PollEventLoop : public EventLoop {
+public:
+    PollEventLoop();
+    virtual ~PollEventLoop();
+
+    virtual bool add(int fd, int events);
+    virtual bool modify(int fd, int events);
+    virtual void remove(int fd);
+    virtual int wait(std::vector<Event>& ready, int timeout_ms);
+    virtual const char* name() const;
+
+private:
+    std::vector<struct pollfd> _fds;
+    std::vector<int> _index; // fd -> position in _fds, -1 if not registered
+};
+
+#ifdef __linux__
+class EpollEventLoop : public EventLoop {
+public:
+    EpollEventLoop();
+    virtual ~EpollEventLoop();
+
+    bool isValid() const;
+
+    virtual bool add(int fd, int events);
+    virtual bool modify(int fd, int events);
+    virtual void remove(int fd);
+    virtual int wait(std::vector<Event>& ready, int timeout_ms);
+    virtual const char* name() const;
+
+private:
+    int _epfd;
+    std::vector<struct epoll_event> _events;
+
+    EpollEventLoop(const EpollEventLoop&);
+    EpollEventLoop& operator=(const EpollEventLoop&);
+};
+#endif
+
+#endif
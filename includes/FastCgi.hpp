@@ -0,0 +1,91 @@
+#ifndef FASTCGI_HPP
+#define FASTCGI_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sys/types.h>
+
+// Record types of the FastCGI 1.0 protocol
+enum FastCgiType {
+    FCGI_BEGIN_REQUEST     = 1,
+    FCGI_ABORT_REQUEST     = 2,
+    FCGI_END_REQUEST       = 3,
+    FCGI_PARAMS            = 4,
+    FCGI_STDIN             = 5,
+    FCGI_STDOUT            = 6,
+    FCGI_STDERR            = 7,
+    FCGI_GET_VALUES        = 9,
+    FCGI_GET_VALUES_RESULT = 10
+};
+
+struct FastCgiRecord {
+    unsigned char type;
+    unsigned short request_id;
+    std::string content;
+};
+
+// Request body to stream as FCGI_STDIN while the backend socket drains
+struct FastCgiBody {
+    std::string data; // In-memory body
+    int fd;           // dup() of a spooled body, owned; -1 otherwise
+    off_t offset;     // Next byte of 'data' or 'fd' to send
+    off_t size;
+
+    FastCgiBody() : fd(-1), offset(0), size(0) {}
+};
+
+struct FastCgiRequest {
+    int client_fd; // -1 once the client went away: records are dropped
+    FastCgiBody body;
+    bool stdin_done;
+
+    FastCgiRequest() : client_fd(-1), stdin_done(false) {}
+};
+
+/**
+ * @brief One persistent, non-blocking connection to a FastCGI backend.
+ *
+ * Requests are begun with FCGI_KEEP_CONN so the connection is reused; it
+ * carries several at once only after the backend announced FCGI_MPXS_CONNS
+ * in reply to the FCGI_GET_VALUES query sent on connect.
+ */
+class FastCgiConnection {
+public:
+    int fd;
+    std::string backend;   // fastcgi_pass address, the pool key
+    bool connected;        // Non-blocking connect() completed
+    size_t max_requests;   // In flight at once on this connection
+    unsigned long timeout_ms;
+    std::map<unsigned short, FastCgiRequest> requests;
+
+    FastCgiConnection();
+
+    // Start a non-blocking connect to "unix:/path" or "host:port", -1 on error
+    static int connectTo(const std::string& address);
+
+    bool hasRoom() const;
+    void queryValues(); // FCGI_GET_VALUES for FCGI_MPXS_CONNS and FCGI_MAX_REQS
+    // Queue BEGIN_REQUEST, PARAMS and the body; returns the request id
+    unsigned short begin(int client_fd, const std::vector<std::string>& params, FastCgiBody& body);
+    void abort(unsigned short id);
+    void finish(unsigned short id);
+    void applyValues(const std::string& content); // FCGI_GET_VALUES_RESULT
+
+    bool hasOutput() const;
+    bool flush();                                     // false on socket error
+    bool receive(std::vector<FastCgiRecord>& records); // false on EOF, error or bad record
+    void release(); // Closes the body fds; the socket is closed by the owner
+
+private:
+    std::string _out;
+    size_t _out_pos;
+    std::string _in;
+    unsigned short _next_id;
+
+    void appendRecord(unsigned char type, unsigned short id, const char* data, size_t len);
+    void appendStream(unsigned char type, unsigned short id, const std::string& data);
+    void fillStdin();
+};
+
+#endif
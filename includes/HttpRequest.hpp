@@ -16,48 +16,130 @@ enum RequestState {
     STATE_COMPLETE
 };
 
+// Byte range inside the request's input buffer
+struct Slice {
+    size_t offset;
+    size_t length;
+
+    Slice() : offset(0), length(0) {}
+    Slice(size_t off, size_t len) : offset(off), length(len) {}
+};
+
+struct HeaderField {
+    Slice name;
+    Slice value;
+};
+
+// Headers the server reads on every request, classified while parsing
+enum KnownHeader {
+    HEADER_HOST,
+    HEADER_CONTENT_LENGTH,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_TYPE,
+    HEADER_RANGE,
+    HEADER_IF_NONE_MATCH,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_EXPECT,
+    HEADER_COUNT
+};
+
 class HttpRequest {
 public:
     HttpRequest();
     ~HttpRequest();
+    HttpRequest(const HttpRequest& other);
+    HttpRequest& operator=(const HttpRequest& other);
 
     // Process incoming raw data
     // Returns true if parsing is complete
     bool parse(const std::string& raw_data);
+    bool parse(const char* data, size_t len);
+
+    // Body limits depend on the server block, so parsing pauses once the
+    // headers are in until the caller provides them
+    bool needsBodyLimits() const;
+    void setBodyLimits(size_t max_body_size, size_t buffer_size, const std::string& temp_dir);
 
     // Getters
     std::string getMethod() const;
     std::string getPath() const;
+    std::string getVersion() const;
+    // Header names match case-insensitively; the last occurrence wins
+    const std::string& getHeader(KnownHeader header) const; // Empty if absent
     std::string getHeader(const std::string& key) const;
-    std::string getBody() const;
+    const std::string& getBody() const; // Empty once the body was spooled to disk
+    size_t getBodySize() const;
+    bool isBodyInFile() const;
+    int getBodyFd() const;
+    int getErrorCode() const; // 0, 400, 413 or 431
     bool isFinished() const;
+    bool hasStarted() const;     // Bytes of a request are buffered
+    bool isReadingBody() const;  // Headers are in, the body is not complete
+    bool keepAlive() const;      // The client lets the connection outlive this request
+
+    // Write the body to 'path' (a spooled body is renamed into place)
+    bool saveBody(const std::string& path);
 
     // Reset for keep-alive connections
     void reset();
+    // Drop pipelined input too, freeing header and body buffers past 'keep_capacity'
+    void clear(size_t keep_capacity);
+    // Exchange the input buffer with a pooled one; only once clear() emptied it
+    void swapBuffer(std::string& buffer);
 
 private:
     RequestState _state;
-    std::string _method;
-    std::string _path;
-    std::string _version;
-    std::map<std::string, std::string> _headers;
-    std::string _body;
-    
-    // Buffer for accumulated data that hasn't been parsed yet
+
+    // Single input buffer. The request line and headers are slices into
+    // [0, _head_end), which is kept until reset(); body bytes after it are
+    // consumed through _pos and only compacted occasionally.
     std::string _buffer;
+    size_t _pos;      // First byte not parsed yet
+    size_t _scan;     // Where the next CRLF search resumes
+    size_t _head_end; // End of the header block (0 while it is incomplete)
+
+    Slice _method;
+    Slice _path;
+    Slice _version;
+    std::vector<HeaderField> _headers;
+    int _known[HEADER_COUNT];                // Index in _headers, -1 if absent
+    std::string _known_values[HEADER_COUNT]; // Copied once the header block ends
+    std::string _body;
+    int _error_code;
+
+    // Body sink: memory up to _body_buffer_size, then a temp file
+    bool _limits_set;
+    size_t _max_body_size;
+    size_t _body_buffer_size;
+    std::string _temp_dir;
+    size_t _body_size;
+    int _body_fd;
+    std::string _body_path;
     
     // Helpers
+    size_t findLineEnd();
+    std::string sliceToString(const Slice& slice) const;
+    const HeaderField* findHeader(const char* name) const;
+    void classifyHeader(size_t index);
+    void compact();
     void parseRequestLine();
     void parseHeaders();
     void parseBody();
     void parseChunkedBody(); 
+    bool appendBody(const char* data, size_t len);
+    bool spillBody();
+    void discardBodyFile();
+    void fail(int error_code);
     
     // Internal tracking for body size
     size_t _content_length;
     
     // Chunked transfer tracking
-    size_t _chunk_length;
+    size_t _chunk_length; // Bytes of the current chunk still to come
     bool _is_chunk_size; // true = waiting for hex size, false = waiting for data
+    bool _in_trailer;    // Last chunk seen, skipping trailer fields
 };
 
 #endif
\ No newline at end of file
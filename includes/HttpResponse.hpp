@@ -1,41 +1,75 @@
-#ifndef HTTPRESPONSE_HPP
-#define HTTPRESPONSE_HPP
-
-#include "HttpRequest.hpp"
-#include "Config.hpp"
-#include "Webserver.hpp" // For Client struct
-#include <fstream>
-#include <sstream>
-#include <sys/stat.h>
-#include <cstdio>
-
-class HttpResponse {
-public:
-    // Main entry point - modifies Client state directly
-    static void processRequest(Client& client, const std::vector<ServerConfig>& configs);
-    
-    // Helper to finish CGI processing
-    static std::string buildCgiResponse(const std::string& cgi_output);
-
-private:
-    static const ServerConfig* findMatchingServer(const HttpRequest& req, const std::vector<ServerConfig>& configs, int client_port);
-    static const LocationConfig* findMatchingLocation(const ServerConfig& server, const std::string& path);
-
-    static std::string handleGetRequest(const LocationConfig& loc_config, const std::string& uri);
-    static std::string handleDeleteRequest(const LocationConfig& loc_config, const std::string& uri);
-    static std::string handlePostRequest(const LocationConfig& loc_config, const HttpRequest& req);
-    
-    // CGI now sets state in Client instead of returning string
-    static void handleCgiRequest(Client& client, const LocationConfig& loc_config, const std::string& script_path);
-    static bool isCgiRequest(const LocationConfig& loc_config, const std::string& path);
-
-    static std::string buildResponseHeader(int status_code, const std::string& status_text, size_t content_length, const std::string& content_type);
-    static std::string buildRedirectResponse(int status_code, const std::string& location);
-    static std::string buildErrorResponse(int status_code, const ServerConfig* server_config);
-    
-    static std::string getFileContent(const std::string& filepath);
-    static std::string getMimeType(const std::string& filepath);
-    static std::string generateDirectoryListing(const std::string& directory_path, const std::string& request_uri);
-};
-
+#ifndef HTTPRESPONSE_HPP
+#define HTTPRESPONSE_HPP
+
+#include "HttpRequest.hpp"
+#include "Config.hpp"
+#include "Webserver.hpp" // For Client struct
+#include "Router.hpp"
+#include "Compression.hpp"
+#include "OpenFileCache.hpp"
+#include "Metrics.hpp"
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <cstdio>
+
+// Inclusive byte range of a Range request, already clamped to the file size
+struct ByteRange {
+    off_t start;
+    off_t end;
+};
+
+class HttpResponse {
+public:
+    // Main entry point - modifies Client state directly
+    static void processRequest(Client& client, const Router& router, StaticCache& cache, StaticCache& gzip_cache,
+                               OpenFileCache& files, const Metrics& metrics);
+    
+    // CGI output streaming: headers once the block is complete, then body chunks
+    static bool beginCgiResponse(Response& res, std::string& cgi_output);
+    static void appendCgiBody(Response& res, const char* data, size_t len);
+    static void endCgiResponse(Response& res);
+    // Output that ended before a header block, takes over the buffer
+    static void buildCgiResponse(Response& res, std::string& cgi_output);
+
+private:
+    // Returns the headers; bodies (file ranges, cached buffers) are already queued on the Response
+    static std::string handleGetRequest(Client& client, const LocationConfig& loc_config, const OpenFile& file,
+                                        const std::string& uri, StaticCache& cache, const std::string& cache_key);
+    static bool handleCompressedGet(Client& client, const LocationConfig& loc_config, const OpenFile& file,
+                                    unsigned codings, StaticCache& gzip_cache, OpenFileCache& files);
+    static std::string handleDeleteRequest(const LocationConfig& loc_config, const std::string& uri);
+    static std::string handlePostRequest(const LocationConfig& loc_config, HttpRequest& req);
+    
+    // CGI now sets state in Client instead of returning string
+    static void handleCgiRequest(Client& client, const LocationConfig& loc_config, const std::string& script_path);
+    static void handleFastCgiRequest(Client& client, const LocationConfig& loc_config, const std::string& script_path);
+    static std::vector<std::string> buildCgiEnv(const HttpRequest& req, const std::string& script_path);
+    static bool isCgiRequest(const LocationConfig& loc_config, const std::string& path);
+
+    // Validators and conditional requests (If-None-Match, If-Modified-Since)
+    static std::string entityTag(const struct stat& st, bool weak);
+    static std::string cacheHeaders(const struct stat& st, const std::string& etag, const LocationConfig& loc_config);
+    static bool isConditional(const HttpRequest& req);
+    static bool notModified(const HttpRequest& req, const std::string& etag, time_t mtime);
+    static std::string buildNotModified(const std::string& headers);
+    static bool parseHttpDate(const std::string& value, time_t& t);
+
+    static int parseRangeHeader(const std::string& header, off_t size, std::vector<ByteRange>& ranges);
+    static bool ifRangeMatches(const HttpRequest& req, const struct stat& st);
+    static std::string buildRangeResponse(Client& client, int fd, const struct stat& st, const std::string& mime,
+                                          const std::vector<ByteRange>& ranges, const std::string& headers);
+
+    static std::string buildResponseHeader(int status_code, const std::string& status_text, size_t content_length,
+                                           const std::string& content_type, const std::string& extra_headers = "");
+    static std::string buildRedirectResponse(int status_code, const std::string& location);
+    static std::string buildErrorResponse(int status_code, const ServerConfig* server_config, OpenFileCache* files = NULL);
+    
+    static std::string getFileContent(const std::string& filepath);
+    static bool readFd(int fd, size_t size, std::string& out);
+    static std::string getMimeType(const std::string& filepath);
+    static std::string httpDate(time_t t);
+    static std::string generateDirectoryListing(const std::string& directory_path, const std::string& request_uri);
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef LOG_HPP
+#define LOG_HPP
+
+#include <string>
+#include <sstream>
+
+// Severity of a diagnostic message, most severe first
+enum LogLevel {
+    LEVEL_ERROR,
+    LEVEL_WARN,
+    LEVEL_INFO,
+    LEVEL_DEBUG
+};
+
+/**
+ * @brief Diagnostics on stderr, filtered by the log_level directive.
+ *
+ * Each message is one write(), with no stream flush. Use the macros: the
+ * message is only formatted when its level is enabled, and LOG_DEBUG is
+ * compiled out unless the server is built with "make DEBUG=1".
+ */
+class Log {
+public:
+    static void setLevel(LogLevel level);
+    static bool enabled(LogLevel level) { return level <= _level; }
+    static void write(LogLevel level, const std::string& message);
+
+    static bool parseLevel(const std::string& name, LogLevel& level);
+
+private:
+    static LogLevel _level;
+};
+
+#define LOG(level, message)                       \
+    do {                                          \
+        if (Log::enabled(level)) {                \
+            std::ostringstream log_message_;      \
+            log_message_ << message;              \
+            Log::write(level, log_message_.str()); \
+        }                                         \
+    } while (0)
+
+#ifdef WEBSERV_DEBUG
+#define LOG_DEBUG(message) LOG(LEVEL_DEBUG, message)
+#else
+#define LOG_DEBUG(message) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef MASTER_HPP
+#define MASTER_HPP
+
+#include "Config.hpp"
+#include "Metrics.hpp"
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @brief Supervises worker processes, each running its own Webserver loop.
+ *
+ * Workers open their own SO_REUSEPORT listeners, so the kernel spreads
+ * incoming connections across them. Crashed workers are respawned into
+ * the same metrics slot, so counters survive them.
+ */
+class Master
+{
+private:
+    const std::vector<ServerConfig>& _configs;
+    const GlobalConfig& _global;
+    Metrics& _metrics; // One slot per worker, mapped before the first fork()
+    std::vector<pid_t> _workers;
+    std::vector<time_t> _spawn_times;
+
+    pid_t spawnWorker(size_t index);
+    void stopWorkers();
+
+    Master(const Master&);
+    Master& operator=(const Master&);
+
+public:
+    Master(const std::vector<ServerConfig>& configs, const GlobalConfig& global, Metrics& metrics,
+           int worker_processes);
+    ~Master();
+
+    void run();
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <cstddef>
+
+class Router;
+
+// Latency buckets are powers of two, bound included as Prometheus "le" means:
+// <= 1 ms, <= 2 ms, ... <= 32768 ms, then +Inf
+static const int LATENCY_BUCKETS = 16;
+
+// Counters of one worker process, written by that worker only
+struct WorkerStats {
+    // Gauges, reset when a worker takes the slot over
+    unsigned long long connections_active;
+    unsigned long long connections_idle; // Keep-alive, waiting for a request
+    unsigned long long cgi_running;
+
+    unsigned long long connections_accepted;
+    unsigned long long connections_handled;
+    unsigned long long connections_reaped; // Idle keep-alive closed to make room at worker_connections
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    unsigned long long cgi_timeouts; // CGI scripts and FastCGI backends
+    unsigned long long responses[5]; // 1xx .. 5xx
+    unsigned long long latency[LATENCY_BUCKETS + 1];
+    unsigned long long latency_sum_ms;
+};
+
+// Responses of one location (Route::id); slot 0 counts unrouted requests
+struct LocationStats {
+    unsigned long long responses[5];
+};
+
+/**
+ * @brief Counters for the stub_status endpoint, in Prometheus text format.
+ *
+ * All slots live in one shared anonymous mapping created before the
+ * workers fork: each worker bumps plain integers in its own slot, with no
+ * lock or atomic, and a scrape sums every slot. Latency is measured with
+ * the clock read once per event loop iteration.
+ */
+class Metrics {
+public:
+    Metrics();
+    ~Metrics();
+
+    // Before fork(): one slot per worker, 'locations' as counted by the router
+    void allocate(size_t workers, size_t locations);
+    // In the worker: select its slot, dropping the gauges of a previous owner
+    void attach(size_t worker);
+
+    WorkerStats& stats() { return *_stats; }
+    void recordResponse(int route, int status, unsigned long long latency_ms);
+
+    std::string render(const Router& router) const;
+
+    static unsigned long long nowMs(); // Monotonic
+
+private:
+    char* _base;
+    size_t _size;
+    size_t _workers;
+    size_t _locations;
+    size_t _slot_size;
+    WorkerStats* _stats;
+    LocationStats* _location_stats;
+
+    const WorkerStats& workerSlot(size_t worker) const;
+    const LocationStats* locationSlots(size_t worker) const;
+
+    Metrics(const Metrics&);
+    Metrics& operator=(const Metrics&);
+};
+
+#endif
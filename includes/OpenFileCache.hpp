@@ -0,0 +1,60 @@
+#ifndef OPENFILECACHE_HPP
+#define OPENFILECACHE_HPP
+
+#include <string>
+#include <list>
+#include <map>
+#include <ctime>
+#include <sys/stat.h>
+
+struct OpenFile {
+    std::string path;
+    int err;           // errno of open()/fstat(), 0 when the file exists
+    struct stat st;    // Valid when err == 0
+    int fd;            // Open regular file, -1 for directories and errors
+    time_t checked_at; // Last stat() revalidation
+
+    OpenFile() : err(0), fd(-1), checked_at(0) {}
+};
+
+/**
+ * @brief Bounded LRU of resolved paths: open fd, stat() result or the error.
+ *
+ * Routing, the static handler and error pages look paths up here, so a hot
+ * file costs no metadata syscall until its entry is older than the validity
+ * interval; it is then re-stat()ed and reopened only if it changed. Failed
+ * lookups are kept too when negative caching is on.
+ *
+ * A returned entry (and its fd) stays valid until the next lookup() only:
+ * responses that keep sending from the fd take a dup() of it.
+ */
+class OpenFileCache {
+public:
+    OpenFileCache();
+    ~OpenFileCache();
+
+    void configure(size_t max_entries, int valid_seconds, bool cache_errors);
+    bool isEnabled() const;
+
+    const OpenFile& lookup(const std::string& path);
+    void forget(const std::string& path); // The server itself changed the file
+
+private:
+    typedef std::list<OpenFile> LruList; // Front = most recently used
+
+    LruList _lru;
+    std::map<std::string, LruList::iterator> _index;
+    size_t _max_entries;
+    int _valid_seconds;
+    bool _cache_errors;
+    OpenFile _uncached; // Result of a lookup that is not kept
+
+    static void resolve(OpenFile& file);
+    static void release(OpenFile& file);
+    void erase(LruList::iterator it);
+
+    OpenFileCache(const OpenFileCache&);
+    OpenFileCache& operator=(const OpenFileCache&);
+};
+
+#endif
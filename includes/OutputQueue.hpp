@@ -0,0 +1,93 @@
+#ifndef OUTPUTQUEUE_HPP
+#define OUTPUTQUEUE_HPP
+
+#include <string>
+#include <deque>
+#include <sys/types.h>
+
+/**
+ * @brief Immutable, reference-counted bytes shared by the cache and responses.
+ *
+ * Copying only bumps a counter, so a cached response can be queued on many
+ * connections at once and outlive its eviction from the cache.
+ */
+class SharedBuffer {
+public:
+    SharedBuffer();
+    explicit SharedBuffer(const std::string& bytes);
+    SharedBuffer(const SharedBuffer& other);
+    SharedBuffer& operator=(const SharedBuffer& other);
+    ~SharedBuffer();
+
+    const char* data() const;
+    size_t size() const;
+
+private:
+    struct Block {
+        std::string bytes;
+        int refs;
+    };
+    Block* _block;
+
+    void release();
+};
+
+// One piece of a response, sent as-is without being joined to the others
+struct OutputSegment {
+    enum Kind { SEG_OWNED, SEG_SHARED, SEG_FILE };
+
+    Kind kind;
+    std::string owned;   // SEG_OWNED
+    SharedBuffer shared; // SEG_SHARED
+    int fd;              // SEG_FILE: not owned, see Response::file_fd
+    off_t offset;        // SEG_FILE, and SEG_SHARED bytes skipped at the start
+    size_t length;
+
+    OutputSegment() : kind(SEG_OWNED), fd(-1), offset(0), length(0) {}
+};
+
+/**
+ * @brief Ordered segments of one response, flushed with writev() and sendfile().
+ *
+ * Consecutive memory segments go out in a single writev(); a partial write
+ * only moves a cursor into the front segment instead of erasing bytes.
+ */
+class OutputQueue {
+public:
+    enum FlushStatus {
+        FLUSH_DONE,  // Everything was sent
+        FLUSH_AGAIN, // Socket buffer full, wait for the next write event
+        FLUSH_SHORT, // A file ended before its announced length
+        FLUSH_ERROR  // The socket or the file failed, the response is lost
+    };
+
+    OutputQueue();
+
+    void append(const std::string& bytes);
+    void adopt(std::string& bytes); // Takes the contents, leaving 'bytes' empty
+    void appendShared(const SharedBuffer& buffer);
+    void appendFile(int fd, off_t offset, size_t length);
+    // Headers are only known once the body is queued; nothing may be sent yet
+    void prepend(const std::string& bytes);
+    // Header lines after the status line of the leading segment; nothing may be sent yet
+    void insertAfterStatusLine(const std::string& bytes);
+
+    bool empty() const;
+    size_t bufferedBytes() const; // Memory segments only, file ranges excluded
+    unsigned long long sentBytes() const; // Written to the socket so far
+    // Copy up to 'len' unsent bytes of the leading memory segment, e.g. the status line
+    size_t peek(char* buf, size_t len) const;
+    void clear();
+    FlushStatus flush(int sock_fd);
+
+private:
+    std::deque<OutputSegment> _segments;
+    size_t _cursor; // Bytes of the front memory segment already sent
+    size_t _bytes;  // Unsent bytes of memory segments
+    unsigned long long _sent;
+
+    FlushStatus flushMemory(int sock_fd);
+    FlushStatus flushFile(int sock_fd, OutputSegment& segment);
+};
+
+#endif
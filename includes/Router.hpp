@@ -0,0 +1,75 @@
+#ifndef ROUTER_HPP
+#define ROUTER_HPP
+
+#include "Config.hpp"
+#include <string>
+#include <vector>
+
+// Methods of an allow_methods list, one bit each
+enum MethodBit {
+    METHOD_GET    = 1 << 0,
+    METHOD_POST   = 1 << 1,
+    METHOD_DELETE = 1 << 2
+};
+
+// Location that serves a request path, with its allow-list as a bitmask
+struct Route {
+    const LocationConfig* location; // NULL when no location matches
+    const ServerConfig* server;     // Block the location belongs to
+    unsigned methods;
+    int id; // Index among all routes, -1 when no location matches
+
+    Route() : location(NULL), server(NULL), methods(0), id(-1) {}
+};
+
+/**
+ * @brief Routing tables compiled once from the configuration, read-only afterwards.
+ *
+ * Server blocks are found through a hash of (port, Host). The locations of
+ * each server form a trie of path segments, so the longest prefix costs one
+ * step per segment and "/uploads" matches "/uploads/a" but not "/uploadsXYZ".
+ */
+class Router {
+public:
+    Router();
+
+    // 'configs' must outlive the router, its blocks are referenced
+    void build(const std::vector<ServerConfig>& configs);
+
+    // Block whose server_name matches Host on this port, else the port's first block
+    const ServerConfig* findServer(int port, const std::string& host) const;
+    Route findLocation(const ServerConfig& server, const std::string& path) const;
+
+    // Every location, by Route::id; at most the total number of location blocks
+    size_t routeCount() const;
+    const Route& route(size_t id) const;
+
+    static unsigned methodBit(const std::string& method); // 0 for unknown methods
+
+private:
+    struct VirtualHost {
+        int port;
+        std::string name; // Lowercase
+        const ServerConfig* server;
+    };
+
+    struct TrieNode {
+        std::vector<std::pair<std::string, int> > children; // Sorted by segment
+        int route; // Index in _routes, -1 if no location ends here
+
+        TrieNode() : route(-1) {}
+    };
+
+    const ServerConfig* _first;
+    std::vector<std::vector<VirtualHost> > _buckets; // Power-of-two count
+    std::vector<std::pair<int, const ServerConfig*> > _defaults; // First block of each port
+    std::vector<int> _roots; // Trie root of each block, same index as 'configs'
+    std::vector<TrieNode> _nodes;
+    std::vector<Route> _routes;
+
+    static size_t hashName(int port, const char* name, size_t len);
+    void addLocation(int root, const ServerConfig& server, const LocationConfig& location);
+    int findChild(int node, const char* segment, size_t len) const;
+};
+
+#endif
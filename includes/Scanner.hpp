@@ -0,0 +1,29 @@
+#ifndef SCANNER_HPP
+#define SCANNER_HPP
+
+#include <cstddef>
+
+/**
+ * @brief Delimiter and token scans used by the request parser.
+ *
+ * On x86 the blank and token scans test 16 (SSE2) or 32 (AVX2) bytes per
+ * step; the widest variant the CPU supports is picked at startup. Elsewhere,
+ * or when built with "make SIMD=0", portable byte loops are used. Line feeds
+ * are found with memchr, which libc already vectorizes for the CPU.
+ */
+class Scanner {
+public:
+    // Offset of the first '\n', or len
+    static size_t findLineFeed(const char* data, size_t len);
+    // Offset of the first ' ' or '\t', or len
+    static size_t findBlank(const char* data, size_t len);
+    // Length of the leading run of token characters (RFC 9110 tchar)
+    static size_t tokenLength(const char* data, size_t len);
+
+    // "avx2", "sse2" or "portable"
+    static const char* implementation();
+    // Switch variants (benchmarks, fuzzing); false if the CPU lacks it
+    static bool useImplementation(const char* name);
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef STATICCACHE_HPP
+#define STATICCACHE_HPP
+
+#include <string>
+#include <list>
+#include <map>
+#include <ctime>
+#include <sys/types.h>
+#include "OutputQueue.hpp"
+
+struct CachedResponse {
+    std::string key;       // Request path under the location root
+    std::string file_path; // File that was actually served (index resolved)
+    SharedBuffer response; // Fully serialized headers + body, queued without copying;
+                           // empty when the gzip cache found the file not worth compressing
+    off_t size;
+    time_t mtime;
+    time_t checked_at;     // Last stat() revalidation
+};
+
+/**
+ * @brief LRU cache of small static responses, bounded by a byte budget.
+ *
+ * A hit costs no file syscalls; entries are re-stat()ed at most once per
+ * validity interval and dropped when the file's size or mtime changed.
+ */
+class StaticCache {
+public:
+    StaticCache();
+
+    void configure(unsigned long max_bytes, unsigned long max_file, int valid_seconds);
+    bool isEnabled() const;
+    bool accepts(off_t file_size) const;
+
+    // Returns NULL on miss or when the file changed since it was cached
+    const CachedResponse* lookup(const std::string& key);
+    void insert(const std::string& key, const std::string& file_path,
+                const struct stat& st, const SharedBuffer& response);
+    // The server itself changed the file: drop it without waiting for stat()
+    void forget(const std::string& path);
+
+private:
+    typedef std::list<CachedResponse> LruList; // Front = most recently used
+
+    LruList _lru;
+    std::map<std::string, LruList::iterator> _index;
+    std::multimap<std::string, std::string> _keys_by_file; // file_path -> keys serving it
+    unsigned long _bytes;
+    unsigned long _max_bytes;
+    unsigned long _max_file;
+    int _valid_seconds;
+
+    void erase(LruList::iterator it);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * @brief Hierarchical timing wheel holding at most one timer per fd.
+ *
+ * Four levels of 64 slots with a 100 ms tick cover about 19 days. Timers
+ * live in fd-indexed doubly linked lists, so arming, re-arming and
+ * cancelling are O(1); a tick only touches the timers that expire on it
+ * or cascade down a level.
+ */
+class TimerWheel {
+public:
+    static const unsigned long TICK_MS = 100;
+
+    TimerWheel();
+
+    void arm(int fd, unsigned long timeout_ms); // Replaces any pending timer of fd
+    void cancel(int fd);
+    bool isArmed(int fd) const;
+
+    // Milliseconds the event loop may sleep, -1 when nothing is armed
+    int nextTimeout() const;
+    // Advance to the current time and collect the fds whose timer fired
+    void expire(std::vector<int>& expired);
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+
+    struct Node {
+        int prev;
+        int next;
+        int slot; // -1 when not armed
+        unsigned long long expires; // In ticks
+        Node() : prev(-1), next(-1), slot(-1), expires(0) {}
+    };
+
+    std::vector<Node> _nodes; // Indexed by fd
+    int _heads[LEVELS * SLOTS];
+    unsigned long long _now;  // Last processed tick
+    unsigned long long _start_ms;
+    size_t _count;
+
+    static unsigned long long monotonicMs();
+    void place(int fd);
+    void unlink(int fd);
+    void cascade(int level);
+};
+
+#endif
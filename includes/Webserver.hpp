@@ -2,8 +2,18 @@
 #define WEBSERVER_HPP
 
 #include "Config.hpp"
+#include "EventLoop.hpp"
+#include "StaticCache.hpp"
+#include "OpenFileCache.hpp"
+#include "Metrics.hpp"
+#include "AccessLog.hpp"
+#include "OutputQueue.hpp"
+#include "TimerWheel.hpp"
+#include "FastCgi.hpp"
+#include "Router.hpp"
+#include "ConnectionTable.hpp"
 #include <vector>
-#include <poll.h>
+#include <deque>
 #include <map>
 #include <string>
 #include <iostream>
@@ -17,49 +27,187 @@
 #include <sys/wait.h>
 #include "HttpRequest.hpp"
 
+// One HTTP response; a connection sends them in request order
+struct Response
+{
+    OutputQueue out;  // Headers, bodies and file ranges, never joined
+    bool ready;       // Can be sent: complete, or a CGI stream whose headers are in
+    bool streaming;   // A CGI is still appending body bytes
+    bool chunked;     // Streamed body is framed with chunked encoding
+    bool close_after; // Close the connection once this response is sent
+    bool http10;      // HTTP/1.0 client: no chunked framing, keep-alive only if announced
+
+    // Static file referenced by the SEG_FILE segments of 'out'
+    int file_fd;
+
+    // Metrics: location, status read from the first bytes sent, dispatch time
+    int route;
+    int status;
+    unsigned long long started_ms;
+
+    // Line written once the response is sent, NULL when the server does not log
+    AccessLog* access_log;
+    AccessEntry access;
+
+    Response() : ready(false), streaming(false), chunked(false), close_after(false), http10(false), file_fd(-1),
+                 route(-1), status(0), started_ms(0), access_log(NULL) {}
+
+    void closeFile()
+    {
+        if (file_fd != -1)
+            close(file_fd);
+        file_fd = -1;
+        out.clear();
+    }
+};
+
+// What the client timer currently measures
+enum TimerPhase
+{
+    TIMER_NONE,      // Waiting on a CGI, which has its own timer
+    TIMER_KEEPALIVE, // Idle between requests
+    TIMER_HEADER,    // Request line and headers, not reset by reads
+    TIMER_BODY,      // Reset by every read
+    TIMER_SEND       // Reset by every write
+};
+
 struct Client
 {
     int fd;
     HttpRequest request;
-    std::string response_buffer;
-    bool is_ready_to_write;
     int listening_port;
+    struct in_addr remote_addr;
+    const ServerConfig* server; // Default server of the port, owns the timeouts
+    TimerPhase timer_phase;
+    int requests; // Answered on this connection, see keepalive_requests
+
+    // Pipelined responses, front is being sent, back belongs to the current request
+    std::deque<Response> responses;
+    bool closing; // A queued response ends the connection: stop reading
 
     // CGI State
     bool is_cgi_active;
     int cgi_pid;
     int cgi_pipe_out; // Read from this
+    bool cgi_paused;  // Output not read while the client lags behind
+    unsigned long cgi_timeout_ms; // Max silence of the script or FastCGI backend
+    int cgi_pipe_in;  // In-memory body is written here as the script reads it
+    std::string cgi_input;
+    size_t cgi_input_pos;
     std::string cgi_output_buffer;
-	time_t cgi_start_time;
 
-    Client() : fd(-1), is_ready_to_write(false), listening_port(0), 
-               is_cgi_active(false), cgi_pid(-1), cgi_pipe_out(-1), cgi_start_time(0) {}
+    // FastCGI State (is_cgi_active is set too; stdout goes to cgi_output_buffer)
+    std::string fastcgi_pass; // Backend address, empty for fork/execve CGI
+    std::vector<std::string> fastcgi_params;
+    FastCgiBody fastcgi_body; // Handed to the connection when the request begins
+    int fastcgi_fd;           // Backend connection, -1 while waiting for one
+    unsigned short fastcgi_id;
+
+    Client() : fd(-1), listening_port(0), server(NULL), timer_phase(TIMER_NONE), requests(0), closing(false),
+               is_cgi_active(false), cgi_pid(-1), cgi_pipe_out(-1), cgi_paused(false), cgi_timeout_ms(0),
+               cgi_pipe_in(-1), cgi_input_pos(0), fastcgi_fd(-1), fastcgi_id(0)
+    {
+        remote_addr.s_addr = 0;
+    }
+
+    // Back to the constructed state, keeping request buffers up to 'keep_capacity'
+    void reuse(size_t keep_capacity);
+};
+
+// What a registered fd is, so events can be dispatched without searching
+enum FdType
+{
+    FD_NONE,
+    FD_LISTENER,
+    FD_CLIENT,
+    FD_CGI_OUT,
+    FD_CGI_IN,
+    FD_FASTCGI
+};
+
+struct FdEntry
+{
+    FdType type;
+    int owner; // Listener: port, CGI pipes: client fd, Client and FastCGI: unused
+
+    FdEntry() : type(FD_NONE), owner(-1) {}
 };
 
 class Webserver
 {
 private:
-    std::vector<struct pollfd> _fds;
-    std::vector<int> _server_fds;
-    std::map<int, Client> _clients;
-    std::map<int, int> _cgi_fd_to_client_fd; // Maps CGI pipe FD -> Client FD
+    EventLoop* _loop;
+    std::vector<FdEntry> _fd_table; // Indexed by fd
+    ConnectionTable _clients;
+    TimerWheel _timers; // Client and CGI timeouts, keyed by fd
+    std::vector<int> _expired;
+    std::map<int, FastCgiConnection> _fastcgi; // Backend connections by fd
+    std::deque<int> _fastcgi_waiting;          // Clients waiting for a free connection
+    bool _reuse_port; // One SO_REUSEPORT listener per worker process
+    size_t _pipeline_depth; // Max queued responses per connection
+    size_t _fastcgi_max_conns; // Connections per FastCGI backend
+    std::vector<int> _listeners;
+    size_t _worker_connections; // Open client connections before accepting pauses
+    bool _accept_paused;
+    size_t _accept_resume_below; // Paused listeners return below this many clients (0: on a timer)
+    StaticCache _static_cache;
+    StaticCache _gzip_cache; // Responses compressed on the fly
+    OpenFileCache _open_files; // Descriptors and stat() results of served paths
+    Metrics* _metrics; // Slot of this worker in the shared counters
+    unsigned long long _now_ms; // Read once per loop iteration
+    std::vector<AccessLog*> _access_logs; // One per file, shared by its servers
+    std::map<const ServerConfig*, AccessLog*> _server_logs;
 
     void initSocket(int port);
     void acceptConnection(int server_fd);
+    void pauseAccept(size_t resume_below);
+    void resumeAccept();
+    void relieveAccept();
     
     // Return true if connection is still active, false if closed/erased
     bool handleClientRead(int client_fd);
     void handleClientWrite(int client_fd);
     bool handleCgiRead(int cgi_fd);
+    void handleCgiWrite(int cgi_fd);
+    void closeCgiInput(Client& client);
+    void streamCgiOutput(Client& client, const char* data, size_t len);
+    void finishCgiOutput(Client& client);
+    void abortCgiOutput(Client& client, const char* response);
+    void updateCgiEvents(Client& client);
+
+    void registerFd(int fd, FdType type, int owner, int events);
+    void unregisterFd(int fd);
+    void updateClientEvents(int client_fd);
+    void updateClientTimer(Client& client, bool progress);
+    void processPipeline(int client_fd);
+    void closeClient(int client_fd);
+    void parkIfIdle(int client_fd);
+    void expireTimers();
+    void handleClientTimeout(int client_fd);
+    void handleCgiTimeout(int cgi_fd);
+    void logResponse(Response& res);
+    int nextTimeout() const;
+
+    void startFastCgi(int client_fd);
+    bool assignFastCgi(int client_fd);
+    void handleFastCgiEvent(int fd, int events);
+    void finishFastCgi(FastCgiConnection& conn, const FastCgiRecord& record);
+    void closeFastCgi(int fd, const char* response);
+    void updateFastCgiEvents(int fd);
+    void dispatchFastCgiWaiting();
+
+    Router _router; // Compiled from the configs, which outlive the server
 
-    std::map<int, int> _server_fd_to_port;
-    const std::vector<ServerConfig>* _configs_ptr;
+    Webserver(const Webserver&);
+    Webserver& operator=(const Webserver&);
 
 public:
     Webserver();
     ~Webserver();
 
-    void init(const std::vector<ServerConfig>& configs);
+    // 'worker' selects the metrics slot, which must be allocated before fork()
+    void init(const std::vector<ServerConfig>& configs, const GlobalConfig& global, Metrics& metrics,
+              size_t worker = 0, bool reuse_port = false);
     void run();
 };
 
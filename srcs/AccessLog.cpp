@@ -0,0 +1,213 @@
+#include "../includes/AccessLog.hpp"
+#include "../includes/Log.hpp"
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+/* ************************************************************************** */
+/*                                 LogFormat                                  */
+/* ************************************************************************** */
+
+const char *const LogFormat::DEFAULT =
+	"$remote_addr - - [$time_local] \"$request\" $status $bytes_sent $request_time";
+
+void LogFormat::compile(const std::string &format)
+{
+	static const struct
+	{
+		const char *name;
+		Variable variable;
+	} variables[] = {{"remote_addr", VAR_REMOTE_ADDR}, {"time_local", VAR_TIME_LOCAL},
+					 {"request_time", VAR_REQUEST_TIME}, {"request", VAR_REQUEST},
+					 {"method", VAR_METHOD},			 {"uri", VAR_URI},
+					 {"status", VAR_STATUS},			 {"bytes_sent", VAR_BYTES_SENT},
+					 {"host", VAR_HOST}};
+
+	_parts.clear();
+	size_t pos = 0;
+	while (pos < format.size())
+	{
+		// 1. Literal text up to the next variable
+		size_t dollar = format.find('$', pos);
+		if (dollar != pos)
+		{
+			Part part;
+			part.variable = VAR_LITERAL;
+			part.literal = format.substr(pos, dollar - pos);
+			_parts.push_back(part);
+			if (dollar == std::string::npos)
+				break;
+		}
+
+		// 2. Variable name: [a-z_]+
+		size_t end = dollar + 1;
+		while (end < format.size() && (std::islower((unsigned char)format[end]) || format[end] == '_'))
+			++end;
+		std::string name = format.substr(dollar + 1, end - dollar - 1);
+		size_t i = 0;
+		while (i < sizeof(variables) / sizeof(variables[0]) && name != variables[i].name)
+			++i;
+		if (i == sizeof(variables) / sizeof(variables[0]))
+			throw std::runtime_error("Error: Unknown log_format variable '$" + name + "'");
+		Part part;
+		part.variable = variables[i].variable;
+		_parts.push_back(part);
+		pos = end;
+	}
+}
+
+void LogFormat::format(const AccessEntry &entry, std::string &line) const
+{
+	// The local time only changes once a second
+	static time_t cached_time = 0;
+	static char time_local[40];
+
+	char number[32];
+	line.clear();
+	for (size_t i = 0; i < _parts.size(); ++i)
+	{
+		switch (_parts[i].variable)
+		{
+		case VAR_LITERAL:
+			line += _parts[i].literal;
+			break;
+		case VAR_REMOTE_ADDR:
+		{
+			char addr[INET_ADDRSTRLEN];
+			line += inet_ntop(AF_INET, &entry.remote_addr, addr, sizeof(addr)) ? addr : "-";
+			break;
+		}
+		case VAR_TIME_LOCAL:
+		{
+			time_t now = time(NULL);
+			if (now != cached_time)
+			{
+				strftime(time_local, sizeof(time_local), "%d/%b/%Y:%H:%M:%S %z", localtime(&now));
+				cached_time = now;
+			}
+			line += time_local;
+			break;
+		}
+		case VAR_REQUEST:
+			line += entry.method + " " + entry.uri + " " + entry.version;
+			break;
+		case VAR_METHOD:
+			line += entry.method;
+			break;
+		case VAR_URI:
+			line += entry.uri;
+			break;
+		case VAR_STATUS:
+			snprintf(number, sizeof(number), "%d", entry.status);
+			line += number;
+			break;
+		case VAR_BYTES_SENT:
+			snprintf(number, sizeof(number), "%llu", entry.bytes_sent);
+			line += number;
+			break;
+		case VAR_REQUEST_TIME:
+			snprintf(number, sizeof(number), "%llu.%03llu", entry.duration_ms / 1000, entry.duration_ms % 1000);
+			line += number;
+			break;
+		case VAR_HOST:
+			line += entry.host.empty() ? "-" : entry.host;
+			break;
+		}
+	}
+	line += '\n';
+}
+
+/* ************************************************************************** */
+/*                                 AccessLog                                  */
+/* ************************************************************************** */
+
+AccessLog::AccessLog(const std::string &path, const std::string &format, size_t buffer_size, unsigned long flush_ms)
+	: _path(path), _fd(-1), _ring(buffer_size), _head(0), _used(0), _flush_ms(flush_ms), _oldest_ms(0)
+{
+	_format.compile(format);
+	_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (_fd < 0)
+		throw std::runtime_error("Error: Cannot open access_log '" + path + "': " + strerror(errno));
+	fcntl(_fd, F_SETFD, FD_CLOEXEC); // Keep it out of CGI children
+}
+
+AccessLog::~AccessLog()
+{
+	flush();
+	close(_fd);
+}
+
+void AccessLog::log(const AccessEntry &entry, unsigned long long now_ms)
+{
+	_format.format(entry, _line);
+
+	// 1. Size trigger: make room, or write an oversized line straight through
+	if (_used + _line.size() > _ring.size())
+		flush();
+	if (_line.size() > _ring.size())
+	{
+		ssize_t ret = write(_fd, _line.data(), _line.size());
+		(void)ret;
+		return;
+	}
+
+	// 2. Copy into the ring, wrapping around its end
+	if (_used == 0)
+		_oldest_ms = now_ms;
+	size_t tail = (_head + _used) % _ring.size();
+	size_t first = std::min(_line.size(), _ring.size() - tail);
+	std::memcpy(&_ring[tail], _line.data(), first);
+	std::memcpy(&_ring[0], _line.data() + first, _line.size() - first);
+	_used += _line.size();
+}
+
+long AccessLog::untilFlush(unsigned long long now_ms) const
+{
+	if (_used == 0)
+		return -1;
+	unsigned long long due = _oldest_ms + _flush_ms;
+	return due > now_ms ? (long)(due - now_ms) : 0;
+}
+
+void AccessLog::flushIfDue(unsigned long long now_ms)
+{
+	if (_used != 0 && now_ms >= _oldest_ms + _flush_ms)
+		flush();
+}
+
+/**
+ * @brief Write the whole ring, both halves in one writev().
+ */
+void AccessLog::flush()
+{
+	while (_used > 0)
+	{
+		struct iovec iov[2];
+		size_t first = std::min(_used, _ring.size() - _head);
+		iov[0].iov_base = &_ring[_head];
+		iov[0].iov_len = first;
+		iov[1].iov_base = &_ring[0];
+		iov[1].iov_len = _used - first;
+		ssize_t written = writev(_fd, iov, iov[1].iov_len ? 2 : 1);
+		if (written <= 0)
+		{
+			if (written < 0 && errno == EINTR)
+				continue;
+			// Full disk or similar: drop the batch rather than block the server
+			LOG(LEVEL_ERROR, "access_log " << _path << ": " << strerror(errno));
+			_used = 0;
+			break;
+		}
+		_head = (_head + written) % _ring.size();
+		_used -= written;
+	}
+	_head = 0;
+}
@@ -0,0 +1,116 @@
+#include "../includes/Compression.hpp"
+#include <cstdlib>
+#include <cctype>
+#ifdef WEBSERV_ZLIB
+#include <zlib.h>
+#endif
+
+static std::string lowercase(const std::string &str)
+{
+	std::string lower = str;
+	for (size_t i = 0; i < lower.size(); ++i)
+		lower[i] = std::tolower((unsigned char)lower[i]);
+	return lower;
+}
+
+/**
+ * @brief Parse "gzip, br;q=0.8, *;q=0" into the codings the client takes.
+ */
+unsigned Compression::acceptedCodings(const std::string &accept_encoding)
+{
+	unsigned accepted = 0;
+	unsigned listed = 0;
+	bool wildcard = false;
+	size_t pos = 0;
+	while (pos < accept_encoding.size())
+	{
+		size_t end = accept_encoding.find(',', pos);
+		if (end == std::string::npos)
+			end = accept_encoding.size();
+		std::string item = lowercase(accept_encoding.substr(pos, end - pos));
+		pos = end + 1;
+
+		// 1. Coding name and optional q-value
+		size_t semi = item.find(';');
+		std::string name = item.substr(0, semi);
+		size_t first = name.find_first_not_of(" \t");
+		size_t last = name.find_last_not_of(" \t");
+		if (first == std::string::npos)
+			continue;
+		name = name.substr(first, last - first + 1);
+		bool allowed = true;
+		if (semi != std::string::npos)
+		{
+			size_t q = item.find("q=", semi);
+			if (q != std::string::npos)
+				allowed = std::strtod(item.c_str() + q + 2, NULL) > 0;
+		}
+
+		// 2. Known codings, the wildcard covers the ones not named
+		unsigned coding = 0;
+		if (name == "gzip" || name == "x-gzip")
+			coding = CODING_GZIP;
+		else if (name == "br")
+			coding = CODING_BR;
+		else if (name == "*")
+			wildcard = allowed;
+		listed |= coding;
+		if (allowed)
+			accepted |= coding;
+	}
+	if (wildcard)
+		accepted |= (CODING_GZIP | CODING_BR) & ~listed;
+	return accepted;
+}
+
+/**
+ * @brief Text formats worth compressing; images and archives already are.
+ */
+bool Compression::isCompressible(const std::string &mime_type)
+{
+	return mime_type.compare(0, 5, "text/") == 0 || mime_type == "application/javascript" ||
+		   mime_type == "application/json" || mime_type == "application/xml" || mime_type == "image/svg+xml";
+}
+
+bool Compression::gzipAvailable()
+{
+#ifdef WEBSERV_ZLIB
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool Compression::gzip(const char *data, size_t len, std::string &out)
+{
+#ifdef WEBSERV_ZLIB
+	z_stream stream;
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+	// 15 + 16: maximum window with a gzip header and trailer
+	if (deflateInit2(&stream, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+
+	out.resize(deflateBound(&stream, len));
+	stream.next_in = (Bytef *)data;
+	stream.avail_in = len;
+	stream.next_out = (Bytef *)&out[0];
+	stream.avail_out = out.size();
+	int ret = deflate(&stream, Z_FINISH);
+	size_t written = stream.total_out;
+	deflateEnd(&stream);
+	if (ret != Z_STREAM_END || written >= len)
+	{
+		out.clear();
+		return false;
+	}
+	out.resize(written);
+	return true;
+#else
+	(void)data;
+	(void)len;
+	out.clear();
+	return false;
+#endif
+}
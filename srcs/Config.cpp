@@ -1,6 +1,8 @@
 #include "../includes/Config.hpp"
+#include "../includes/Compression.hpp"
 #include <cstdlib>	 // for atoi
 #include <algorithm> // for std::find
+#include <unistd.h>	 // for sysconf
 
 /**
  * @brief Removes a trailing semicolon from a string, if present.
@@ -15,6 +17,38 @@ static std::string trim(const std::string &str)
 	return s;
 }
 
+/**
+ * @brief Parses a byte size with an optional K/M/G suffix (e.g. "10M").
+ */
+static unsigned long parseSize(const std::string &str)
+{
+	unsigned long size = std::atol(str.c_str());
+	char unit = str.empty() ? '\0' : str[str.size() - 1];
+	if (unit == 'K' || unit == 'k')
+		size *= 1024;
+	else if (unit == 'M' || unit == 'm')
+		size *= 1024 * 1024;
+	else if (unit == 'G' || unit == 'g')
+		size *= 1024 * 1024 * 1024;
+	return size;
+}
+
+/**
+ * @brief Parses a duration in seconds with an optional s/m/h/d suffix (e.g. "30s").
+ */
+static int parseSeconds(const std::string &str)
+{
+	int seconds = std::atoi(str.c_str());
+	char unit = str.empty() ? '\0' : str[str.size() - 1];
+	if (unit == 'm')
+		seconds *= 60;
+	else if (unit == 'h')
+		seconds *= 3600;
+	else if (unit == 'd')
+		seconds *= 86400;
+	return seconds;
+}
+
 /**
  * @brief Checks if the given HTTP method is valid (GET, POST, DELETE).
  */
@@ -67,12 +101,148 @@ std::vector<ServerConfig> ConfigParser::parse(const std::string &filename)
 		}
 		else
 		{
-			throw std::runtime_error("Error: Unexpected token '" + token + "' in global scope");
+			parseGlobalDirective(token, buffer);
 		}
 	}
 	return servers;
 }
 
+/**
+ * @brief Returns the directives found outside of server blocks by the last parse().
+ */
+const GlobalConfig &ConfigParser::getGlobalConfig() const
+{
+	return _global;
+}
+
+/**
+ * @brief Parses a directive in global scope (outside any server block).
+ */
+void ConfigParser::parseGlobalDirective(const std::string &token, std::stringstream &ss)
+{
+	if (token == "worker_processes")
+	{
+		std::string val;
+		ss >> val;
+		val = trim(val);
+		if (val == "auto")
+		{
+			long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+			_global.worker_processes = cpus > 0 ? cpus : 1;
+		}
+		else
+		{
+			_global.worker_processes = std::atoi(val.c_str());
+			if (_global.worker_processes < 1)
+				throw std::runtime_error("Error: Invalid worker_processes '" + val + "'");
+		}
+	}
+	else if (token == "pipeline_depth")
+	{
+		std::string val;
+		ss >> val;
+		_global.pipeline_depth = std::atoi(trim(val).c_str());
+		if (_global.pipeline_depth < 1)
+			throw std::runtime_error("Error: Invalid pipeline_depth '" + val + "'");
+	}
+	else if (token == "fastcgi_connections")
+	{
+		std::string val;
+		ss >> val;
+		_global.fastcgi_connections = std::atoi(trim(val).c_str());
+		if (_global.fastcgi_connections < 1)
+			throw std::runtime_error("Error: Invalid fastcgi_connections '" + val + "'");
+	}
+	else if (token == "worker_connections")
+	{
+		std::string val;
+		ss >> val;
+		_global.worker_connections = std::atoi(trim(val).c_str());
+		if (_global.worker_connections < 1)
+			throw std::runtime_error("Error: Invalid worker_connections '" + val + "'");
+	}
+	else if (token == "static_cache_size")
+	{
+		std::string val;
+		ss >> val;
+		_global.static_cache_size = parseSize(trim(val));
+	}
+	else if (token == "static_cache_max_file")
+	{
+		std::string val;
+		ss >> val;
+		_global.static_cache_max_file = parseSize(trim(val));
+	}
+	else if (token == "static_cache_valid")
+	{
+		std::string val;
+		ss >> val;
+		_global.static_cache_valid = parseSeconds(trim(val));
+	}
+	else if (token == "gzip_cache_size")
+	{
+		std::string val;
+		ss >> val;
+		_global.gzip_cache_size = parseSize(trim(val));
+	}
+	else if (token == "open_file_cache")
+	{
+		std::string val;
+		ss >> val;
+		val = trim(val);
+		if (val == "off")
+			_global.open_file_cache = 0;
+		else
+		{
+			int entries = std::atoi(val.c_str());
+			if (entries < 1)
+				throw std::runtime_error("Error: Invalid open_file_cache '" + val + "'");
+			_global.open_file_cache = entries;
+		}
+	}
+	else if (token == "open_file_cache_valid")
+	{
+		std::string val;
+		ss >> val;
+		_global.open_file_cache_valid = parseSeconds(trim(val));
+	}
+	else if (token == "open_file_cache_errors")
+	{
+		std::string val;
+		ss >> val;
+		val = trim(val);
+		if (val != "on" && val != "off")
+			throw std::runtime_error("Error: Invalid open_file_cache_errors '" + val + "'");
+		_global.open_file_cache_errors = (val == "on");
+	}
+	else if (token == "log_level")
+	{
+		std::string val;
+		ss >> val;
+		val = trim(val);
+		if (!Log::parseLevel(val, _global.log_level))
+			throw std::runtime_error("Error: Invalid log_level '" + val + "'");
+	}
+	else if (token == "log_format")
+	{
+		// The rest of the directive, quoted or not, spaces included
+		std::string format;
+		std::getline(ss, format, ';');
+		size_t first = format.find_first_not_of(" \t\n");
+		size_t last = format.find_last_not_of(" \t\n");
+		format = first == std::string::npos ? "" : format.substr(first, last - first + 1);
+		if (format.size() >= 2 && (format[0] == '\'' || format[0] == '"') && format[format.size() - 1] == format[0])
+			format = format.substr(1, format.size() - 2);
+		LogFormat check;
+		check.compile(format); // Unknown variables fail here, not in a worker
+		_global.log_format = format;
+	}
+	else
+	{
+		throw std::runtime_error("Error: Unexpected token '" + token + "' in global scope");
+	}
+}
+
 /**
  * @brief Parses a server block from the configuration stream.
  */
@@ -98,14 +268,40 @@ void ConfigParser::parseServerBlock(std::stringstream &ss, ServerConfig &config)
 		else if (token == "server_name")
 		{
 			std::string name;
-			ss >> name;
-			config.server_names.push_back(trim(name));
+			while (ss >> name)
+			{
+				if (!trim(name).empty())
+					config.server_names.push_back(trim(name));
+				if (name.find(';') != std::string::npos)
+					break;
+			}
 		}
 		else if (token == "root")
 		{
 			ss >> config.root;
 			config.root = trim(config.root);
 		}
+		else if (token == "access_log")
+		{
+			// access_log <path>|off [buffer=<size>] [flush=<time>];
+			std::string arg;
+			bool first = true;
+			while (ss >> arg)
+			{
+				std::string value = trim(arg);
+				if (first)
+					config.access_log = (value == "off") ? "" : value;
+				else if (value.compare(0, 7, "buffer=") == 0)
+					config.access_log_buffer = parseSize(value.substr(7));
+				else if (value.compare(0, 6, "flush=") == 0)
+					config.access_log_flush = parseSeconds(value.substr(6));
+				else if (!value.empty())
+					throw std::runtime_error("Error: Invalid access_log parameter '" + value + "'");
+				first = false;
+				if (arg.find(';') != std::string::npos)
+					break;
+			}
+		}
 		else if (token == "error_page")
 		{
 			int code;
@@ -117,16 +313,45 @@ void ConfigParser::parseServerBlock(std::stringstream &ss, ServerConfig &config)
 		{
 			std::string sizeStr;
 			ss >> sizeStr;
-			sizeStr = trim(sizeStr);
-			unsigned long size = std::atol(sizeStr.c_str());
-			char unit = sizeStr[sizeStr.size() - 1];
-			if (unit == 'K' || unit == 'k')
-				size *= 1024;
-			else if (unit == 'M' || unit == 'm')
-				size *= 1024 * 1024;
-			else if (unit == 'G' || unit == 'g')
-				size *= 1024 * 1024 * 1024;
-			config.client_max_body_size = size;
+			config.client_max_body_size = parseSize(trim(sizeStr));
+		}
+		else if (token == "client_body_buffer_size")
+		{
+			std::string sizeStr;
+			ss >> sizeStr;
+			config.client_body_buffer_size = parseSize(trim(sizeStr));
+		}
+		else if (token == "client_body_temp_path")
+		{
+			ss >> config.client_body_temp_path;
+			config.client_body_temp_path = trim(config.client_body_temp_path);
+		}
+		else if (token == "keepalive_timeout" || token == "client_header_timeout" || token == "client_body_timeout" ||
+				 token == "send_timeout" || token == "cgi_timeout")
+		{
+			std::string val;
+			ss >> val;
+			int seconds = parseSeconds(trim(val));
+			if (seconds <= 0)
+				throw std::runtime_error("Error: Invalid " + token + " '" + val + "'");
+			if (token == "keepalive_timeout")
+				config.keepalive_timeout = seconds;
+			else if (token == "client_header_timeout")
+				config.client_header_timeout = seconds;
+			else if (token == "client_body_timeout")
+				config.client_body_timeout = seconds;
+			else if (token == "send_timeout")
+				config.send_timeout = seconds;
+			else
+				config.cgi_timeout = seconds;
+		}
+		else if (token == "keepalive_requests")
+		{
+			std::string val;
+			ss >> val;
+			config.keepalive_requests = std::atoi(trim(val).c_str());
+			if (config.keepalive_requests < 1)
+				throw std::runtime_error("Error: Invalid keepalive_requests '" + val + "'");
 		}
 		else if (token == "location")
 		{
@@ -203,5 +428,51 @@ void ConfigParser::parseLocationBlock(std::stringstream &ss, LocationConfig &loc
 					break;
 			}
 		}
+		else if (token == "fastcgi_pass")
+		{
+			ss >> loc.fastcgi_pass;
+			loc.fastcgi_pass = trim(loc.fastcgi_pass);
+			if (loc.fastcgi_pass.compare(0, 5, "unix:") != 0 && loc.fastcgi_pass.find(':') == std::string::npos)
+				throw std::runtime_error("Error: Invalid fastcgi_pass '" + loc.fastcgi_pass + "'");
+		}
+		else if (token == "gzip")
+		{
+			std::string val;
+			ss >> val;
+			loc.gzip = (trim(val) == "on");
+			if (loc.gzip && !Compression::gzipAvailable())
+				throw std::runtime_error("Error: gzip needs a build with zlib (make ZLIB=1)");
+		}
+		else if (token == "gzip_static")
+		{
+			std::string val;
+			ss >> val;
+			loc.gzip_static = (trim(val) == "on");
+		}
+		else if (token == "stub_status")
+		{
+			std::string val;
+			ss >> val;
+			loc.stub_status = (trim(val) == "on");
+		}
+		else if (token == "expires")
+		{
+			std::string val;
+			ss >> val;
+			val = trim(val);
+			loc.has_expires = (val != "off");
+			if (val == "epoch")
+				loc.expires = -1;
+			else if (val == "max")
+				loc.expires = 10L * 365 * 86400;
+			else if (loc.has_expires)
+			{
+				size_t digits = val.find_first_not_of("0123456789");
+				if (val.empty() || digits == 0 || (digits != std::string::npos &&
+									(digits != val.size() - 1 || std::string("smhd").find(val[digits]) == std::string::npos)))
+					throw std::runtime_error("Error: Invalid expires '" + val + "'");
+				loc.expires = parseSeconds(val);
+			}
+		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include "../includes/ConnectionTable.hpp"
+#include "../includes/Webserver.hpp"
+
+// Request buffer size classes, and how many free buffers each one keeps
+static const size_t BUFFER_CLASS_SIZE[ConnectionTable::BUFFER_CLASSES] = {4 * 1024, 16 * 1024, 64 * 1024};
+static const size_t BUFFER_CLASS_FREE[ConnectionTable::BUFFER_CLASSES] = {256, 64, 16};
+
+/**
+ * @brief Clear every field a previous connection set, keeping small buffers.
+ */
+void Client::reuse(size_t keep_capacity)
+{
+	fd = -1;
+	request.clear(keep_capacity);
+	listening_port = 0;
+	remote_addr.s_addr = 0;
+	server = NULL;
+	timer_phase = TIMER_NONE;
+	requests = 0;
+	responses.clear();
+	closing = false;
+	is_cgi_active = false;
+	cgi_pid = -1;
+	cgi_pipe_out = -1;
+	cgi_paused = false;
+	cgi_timeout_ms = 0;
+	cgi_pipe_in = -1;
+	std::string().swap(cgi_input);
+	cgi_input_pos = 0;
+	std::string().swap(cgi_output_buffer);
+	fastcgi_pass.clear();
+	fastcgi_params.clear();
+	fastcgi_body = FastCgiBody();
+	fastcgi_fd = -1;
+	fastcgi_id = 0;
+}
+
+ConnectionTable::ConnectionTable() : _open(0), _parked_head(-1), _parked_tail(-1) {}
+
+ConnectionTable::~ConnectionTable()
+{
+	for (size_t fd = 0; fd < _slots.size(); ++fd)
+		delete _slots[fd].client;
+	for (size_t i = 0; i < _pool.size(); ++i)
+		delete _pool[i];
+}
+
+Client *ConnectionTable::take()
+{
+	Client *client;
+	if (_pool.empty())
+		client = new Client();
+	else
+	{
+		client = _pool.back();
+		_pool.pop_back();
+	}
+	std::string buffer;
+	lendBuffer(buffer);
+	client->request.swapBuffer(buffer);
+	return client;
+}
+
+void ConnectionTable::recycle(Client *client)
+{
+	client->reuse(POOLED_BUFFER_MAX);
+	std::string buffer;
+	client->request.swapBuffer(buffer);
+	returnBuffer(buffer);
+	if (_pool.size() >= POOL_SIZE)
+	{
+		delete client;
+		return;
+	}
+	_pool.push_back(client);
+}
+
+/**
+ * @brief Hand out the smallest free request buffer, or a new one of the smallest class.
+ */
+void ConnectionTable::lendBuffer(std::string &buffer)
+{
+	for (size_t i = 0; i < BUFFER_CLASSES; ++i)
+	{
+		if (!_buffers[i].empty())
+		{
+			buffer.swap(_buffers[i].back());
+			_buffers[i].pop_back();
+			return;
+		}
+	}
+	buffer.reserve(BUFFER_CLASS_SIZE[0]);
+}
+
+/**
+ * @brief Keep an emptied buffer in the largest class its capacity covers.
+ *
+ * Buffers past the largest class, or arriving at a full free list, are freed.
+ */
+void ConnectionTable::returnBuffer(std::string &buffer)
+{
+	size_t capacity = buffer.capacity();
+	if (capacity < BUFFER_CLASS_SIZE[0] || capacity > BUFFER_CLASS_SIZE[BUFFER_CLASSES - 1])
+		return;
+	size_t i = BUFFER_CLASSES - 1;
+	while (capacity < BUFFER_CLASS_SIZE[i])
+		--i;
+	if (_buffers[i].size() >= BUFFER_CLASS_FREE[i])
+		return;
+	_buffers[i].push_back(std::string());
+	_buffers[i].back().swap(buffer);
+}
+
+Client &ConnectionTable::open(int fd)
+{
+	if ((size_t)fd >= _slots.size())
+		_slots.resize(fd + 1);
+	Slot &slot = _slots[fd];
+	if (!slot.client)
+		slot.client = take();
+	slot.open = true;
+	++_open;
+	slot.client->fd = fd;
+	return *slot.client;
+}
+
+/**
+ * @brief Give a parked connection a Client again, as it was when parked.
+ */
+Client &ConnectionTable::restore(int fd)
+{
+	Slot &slot = _slots[fd];
+	unlinkParked(fd);
+	Client *client = take();
+	client->fd = fd;
+	client->listening_port = slot.idle.listening_port;
+	client->remote_addr = slot.idle.remote_addr;
+	client->server = slot.idle.server;
+	client->requests = slot.idle.requests;
+	client->timer_phase = TIMER_KEEPALIVE;
+	slot.client = client;
+	return *client;
+}
+
+/**
+ * @brief Park a connection waiting for its next request with nothing in flight.
+ */
+bool ConnectionTable::park(int fd)
+{
+	Slot &slot = _slots[fd];
+	Client *client = slot.client;
+	if (!client)
+		return true;
+	if (client->timer_phase != TIMER_KEEPALIVE || !client->responses.empty() || client->closing ||
+		client->is_cgi_active || client->cgi_pipe_in != -1 || client->request.hasStarted())
+		return false;
+	slot.idle.listening_port = client->listening_port;
+	slot.idle.remote_addr = client->remote_addr;
+	slot.idle.server = client->server;
+	slot.idle.requests = client->requests;
+	slot.client = NULL;
+	recycle(client);
+
+	// Most recently parked at the tail
+	slot.idle.prev = _parked_tail;
+	slot.idle.next = -1;
+	if (_parked_tail != -1)
+		_slots[_parked_tail].idle.next = fd;
+	else
+		_parked_head = fd;
+	_parked_tail = fd;
+	return true;
+}
+
+void ConnectionTable::unlinkParked(int fd)
+{
+	IdleConnection &idle = _slots[fd].idle;
+	if (idle.prev != -1)
+		_slots[idle.prev].idle.next = idle.next;
+	else
+		_parked_head = idle.next;
+	if (idle.next != -1)
+		_slots[idle.next].idle.prev = idle.prev;
+	else
+		_parked_tail = idle.prev;
+}
+
+void ConnectionTable::close(int fd)
+{
+	if (!contains(fd))
+		return;
+	Slot &slot = _slots[fd];
+	if (slot.client)
+		recycle(slot.client);
+	else
+		unlinkParked(fd);
+	slot.client = NULL;
+	slot.open = false;
+	--_open;
+}
@@ -0,0 +1,206 @@
+#include "../includes/EventLoop.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdio>
+
+/**
+ * @brief Create the best event backend available on this platform.
+ *
+ * epoll is the default on Linux; poll() is only used as a fallback when
+ * epoll is not compiled in or epoll_create fails at runtime.
+ */
+EventLoop *EventLoop::create()
+{
+#ifdef __linux__
+	EpollEventLoop *epoll_loop = new EpollEventLoop();
+	if (epoll_loop->isValid())
+		return epoll_loop;
+	delete epoll_loop;
+#endif
+	return new PollEventLoop();
+}
+
+/* ************************************************************************** */
+/*                                   poll()                                   */
+/* ************************************************************************** */
+
+PollEventLoop::PollEventLoop() {}
+PollEventLoop::~PollEventLoop() {}
+
+static short toPollEvents(int events)
+{
+	short ev = 0;
+	if (events & EVENT_READ)
+		ev |= POLLIN;
+	if (events & EVENT_WRITE)
+		ev |= POLLOUT;
+	return ev;
+}
+
+/**
+ * @brief Register a new fd. The fd -> slot index keeps every operation O(1).
+ */
+bool PollEventLoop::add(int fd, int events)
+{
+	if (fd < 0)
+		return false;
+	if ((size_t)fd >= _index.size())
+		_index.resize(fd + 1, -1);
+	if (_index[fd] != -1)
+		return modify(fd, events);
+
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = toPollEvents(events);
+	pfd.revents = 0;
+	_index[fd] = _fds.size();
+	_fds.push_back(pfd);
+	return true;
+}
+
+bool PollEventLoop::modify(int fd, int events)
+{
+	if (fd < 0 || (size_t)fd >= _index.size() || _index[fd] == -1)
+		return false;
+	_fds[_index[fd]].events = toPollEvents(events);
+	return true;
+}
+
+/**
+ * @brief Unregister an fd by moving the last pollfd into its slot.
+ */
+void PollEventLoop::remove(int fd)
+{
+	if (fd < 0 || (size_t)fd >= _index.size() || _index[fd] == -1)
+		return;
+	int slot = _index[fd];
+	int last = _fds.size() - 1;
+	if (slot != last)
+	{
+		_fds[slot] = _fds[last];
+		_index[_fds[slot].fd] = slot;
+	}
+	_fds.pop_back();
+	_index[fd] = -1;
+}
+
+int PollEventLoop::wait(std::vector<Event> &ready, int timeout_ms)
+{
+	ready.clear();
+	int ret = poll(_fds.empty() ? NULL : &_fds[0], _fds.size(), timeout_ms);
+	if (ret <= 0)
+		return ret;
+
+	for (size_t i = 0; i < _fds.size() && (int)ready.size() < ret; ++i)
+	{
+		if (!_fds[i].revents)
+			continue;
+		Event ev;
+		ev.fd = _fds[i].fd;
+		ev.events = 0;
+		if (_fds[i].revents & POLLIN)
+			ev.events |= EVENT_READ;
+		if (_fds[i].revents & POLLOUT)
+			ev.events |= EVENT_WRITE;
+		if (_fds[i].revents & (POLLHUP | POLLERR | POLLNVAL))
+			ev.events |= EVENT_ERROR;
+		ready.push_back(ev);
+	}
+	return ready.size();
+}
+
+const char *PollEventLoop::name() const { return "poll"; }
+
+/* ************************************************************************** */
+/*                                   epoll                                    */
+/* ************************************************************************** */
+
+#ifdef __linux__
+
+EpollEventLoop::EpollEventLoop() : _epfd(epoll_create(1024)), _events(256)
+{
+	if (_epfd >= 0)
+		fcntl(_epfd, F_SETFD, FD_CLOEXEC);
+}
+
+EpollEventLoop::~EpollEventLoop()
+{
+	if (_epfd >= 0)
+		close(_epfd);
+}
+
+bool EpollEventLoop::isValid() const { return _epfd >= 0; }
+
+static uint32_t toEpollEvents(int events)
+{
+	uint32_t ev = 0;
+	if (events & EVENT_READ)
+		ev |= EPOLLIN;
+	if (events & EVENT_WRITE)
+		ev |= EPOLLOUT;
+	if (events & EVENT_EDGE)
+		ev |= EPOLLET;
+	return ev;
+}
+
+bool EpollEventLoop::add(int fd, int events)
+{
+	struct epoll_event ev;
+	ev.events = toEpollEvents(events);
+	ev.data.fd = fd;
+	if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+		perror("epoll_ctl add");
+		return false;
+	}
+	return true;
+}
+
+bool EpollEventLoop::modify(int fd, int events)
+{
+	struct epoll_event ev;
+	ev.events = toEpollEvents(events);
+	ev.data.fd = fd;
+	if (epoll_ctl(_epfd, EPOLL_CTL_MOD, fd, &ev) < 0)
+	{
+		perror("epoll_ctl mod");
+		return false;
+	}
+	return true;
+}
+
+void EpollEventLoop::remove(int fd)
+{
+	struct epoll_event ev; // Non-NULL for kernels older than 2.6.9
+	epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+int EpollEventLoop::wait(std::vector<Event> &ready, int timeout_ms)
+{
+	ready.clear();
+	int ret = epoll_wait(_epfd, &_events[0], _events.size(), timeout_ms);
+	if (ret <= 0)
+		return ret;
+
+	for (int i = 0; i < ret; ++i)
+	{
+		Event ev;
+		ev.fd = _events[i].data.fd;
+		ev.events = 0;
+		if (_events[i].events & EPOLLIN)
+			ev.events |= EVENT_READ;
+		if (_events[i].events & EPOLLOUT)
+			ev.events |= EVENT_WRITE;
+		if (_events[i].events & (EPOLLHUP | EPOLLERR))
+			ev.events |= EVENT_ERROR;
+		ready.push_back(ev);
+	}
+	// A full batch means more may be pending: grow for the next round
+	if ((size_t)ret == _events.size())
+		_events.resize(_events.size() * 2);
+	return ret;
+}
+
+const char *EpollEventLoop::name() const { return "epoll"; }
+
+#endif
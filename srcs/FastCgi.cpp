@@ -0,0 +1,366 @@
+#include "../includes/FastCgi.hpp"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+
+static const unsigned short FCGI_RESPONDER = 1;
+static const unsigned char FCGI_KEEP_CONN = 1;
+static const size_t FCGI_CHUNK = 32768;      // Content bytes per stream record
+static const size_t FCGI_STDIN_QUEUE = 65536; // Encoded stdin buffered ahead of the socket
+
+FastCgiConnection::FastCgiConnection()
+	: fd(-1), connected(false), max_requests(1), timeout_ms(0), _out_pos(0), _next_id(0) {}
+
+static int nonBlockingSocket(int domain)
+{
+	int fd = socket(domain, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int FastCgiConnection::connectTo(const std::string &address)
+{
+	int fd;
+	int ret;
+	if (address.compare(0, 5, "unix:") == 0)
+	{
+		struct sockaddr_un addr;
+		std::string path = address.substr(5);
+		if (path.size() >= sizeof(addr.sun_path))
+			return -1;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		std::strcpy(addr.sun_path, path.c_str());
+		if ((fd = nonBlockingSocket(AF_UNIX)) < 0)
+			return -1;
+		ret = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+	}
+	else
+	{
+		size_t colon = address.rfind(':');
+		std::string host = address.substr(0, colon);
+		std::string port = address.substr(colon + 1);
+		struct addrinfo hints;
+		struct addrinfo *res;
+		std::memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_NUMERICSERV;
+		if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0)
+			return -1;
+		if ((fd = nonBlockingSocket(res->ai_family)) < 0)
+		{
+			freeaddrinfo(res);
+			return -1;
+		}
+		ret = connect(fd, res->ai_addr, res->ai_addrlen);
+		freeaddrinfo(res);
+	}
+	if (ret < 0 && errno != EINPROGRESS)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+bool FastCgiConnection::hasRoom() const { return requests.size() < max_requests; }
+
+/**
+ * @brief Append one record, padded to a multiple of 8 bytes as recommended.
+ */
+void FastCgiConnection::appendRecord(unsigned char type, unsigned short id, const char *data, size_t len)
+{
+	size_t padding = (8 - (len & 7)) & 7;
+	char header[8];
+	header[0] = 1; // FCGI_VERSION_1
+	header[1] = type;
+	header[2] = (id >> 8) & 0xff;
+	header[3] = id & 0xff;
+	header[4] = (len >> 8) & 0xff;
+	header[5] = len & 0xff;
+	header[6] = padding;
+	header[7] = 0;
+	_out.append(header, 8);
+	if (len)
+		_out.append(data, len);
+	_out.append(padding, '\0');
+}
+
+// Split a stream into records; the caller adds the empty terminating record
+void FastCgiConnection::appendStream(unsigned char type, unsigned short id, const std::string &data)
+{
+	for (size_t pos = 0; pos < data.size(); pos += FCGI_CHUNK)
+	{
+		size_t len = data.size() - pos < FCGI_CHUNK ? data.size() - pos : FCGI_CHUNK;
+		appendRecord(type, id, data.data() + pos, len);
+	}
+}
+
+static void encodeLength(std::string &out, size_t len)
+{
+	if (len < 128)
+	{
+		out += (char)len;
+		return;
+	}
+	out += (char)(((len >> 24) & 0x7f) | 0x80);
+	out += (char)((len >> 16) & 0xff);
+	out += (char)((len >> 8) & 0xff);
+	out += (char)(len & 0xff);
+}
+
+static bool decodeLength(const std::string &in, size_t &pos, size_t &len)
+{
+	if (pos >= in.size())
+		return false;
+	unsigned char first = in[pos];
+	if (!(first & 0x80))
+	{
+		len = first;
+		++pos;
+		return true;
+	}
+	if (pos + 4 > in.size())
+		return false;
+	len = ((size_t)(first & 0x7f) << 24) | ((size_t)(unsigned char)in[pos + 1] << 16) |
+		  ((size_t)(unsigned char)in[pos + 2] << 8) | (unsigned char)in[pos + 3];
+	pos += 4;
+	return true;
+}
+
+/**
+ * @brief Ask whether the backend multiplexes connections (answered with GET_VALUES_RESULT).
+ */
+void FastCgiConnection::queryValues()
+{
+	std::string names;
+	const char *keys[] = {"FCGI_MPXS_CONNS", "FCGI_MAX_REQS"};
+	for (size_t i = 0; i < 2; ++i)
+	{
+		encodeLength(names, std::strlen(keys[i]));
+		encodeLength(names, 0);
+		names += keys[i];
+	}
+	appendRecord(FCGI_GET_VALUES, 0, names.data(), names.size());
+}
+
+void FastCgiConnection::applyValues(const std::string &content)
+{
+	bool mpxs = false;
+	size_t max_reqs = 0;
+	size_t pos = 0;
+	size_t name_len;
+	size_t value_len;
+	while (decodeLength(content, pos, name_len) && decodeLength(content, pos, value_len) &&
+		   pos + name_len + value_len <= content.size())
+	{
+		std::string name = content.substr(pos, name_len);
+		std::string value = content.substr(pos + name_len, value_len);
+		pos += name_len + value_len;
+		if (name == "FCGI_MPXS_CONNS")
+			mpxs = (value == "1");
+		else if (name == "FCGI_MAX_REQS")
+			max_reqs = std::atoi(value.c_str());
+	}
+	if (mpxs)
+		max_requests = (max_reqs > 0 && max_reqs < 64) ? max_reqs : 64;
+}
+
+/**
+ * @brief Queue a responder request; the body follows as the socket drains.
+ */
+unsigned short FastCgiConnection::begin(int client_fd, const std::vector<std::string> &params, FastCgiBody &body)
+{
+	// 1. Free request id, 0 is reserved for management records
+	do
+	{
+		if (++_next_id == 0)
+			_next_id = 1;
+	} while (requests.count(_next_id));
+	unsigned short id = _next_id;
+
+	FastCgiRequest &req = requests[id];
+	req.client_fd = client_fd;
+	req.body.data.swap(body.data);
+	req.body.fd = body.fd;
+	req.body.offset = 0;
+	req.body.size = body.size;
+	body.fd = -1;
+
+	// 2. Responder role, keep the connection open for the next request
+	char begin_body[8] = {0, (char)FCGI_RESPONDER, (char)FCGI_KEEP_CONN, 0, 0, 0, 0, 0};
+	appendRecord(FCGI_BEGIN_REQUEST, id, begin_body, sizeof(begin_body));
+
+	// 3. "NAME=value" environment as name-value pairs, then end of stream
+	std::string encoded;
+	for (size_t i = 0; i < params.size(); ++i)
+	{
+		size_t eq = params[i].find('=');
+		if (eq == std::string::npos)
+			continue;
+		encodeLength(encoded, eq);
+		encodeLength(encoded, params[i].size() - eq - 1);
+		encoded.append(params[i], 0, eq);
+		encoded.append(params[i], eq + 1, std::string::npos);
+	}
+	appendStream(FCGI_PARAMS, id, encoded);
+	appendRecord(FCGI_PARAMS, id, NULL, 0);
+
+	fillStdin();
+	return id;
+}
+
+/**
+ * @brief The client went away: stop its body and tell the backend.
+ *
+ * The id stays reserved until FCGI_END_REQUEST so a late record is dropped
+ * instead of reaching a new request.
+ */
+void FastCgiConnection::abort(unsigned short id)
+{
+	std::map<unsigned short, FastCgiRequest>::iterator it = requests.find(id);
+	if (it == requests.end())
+		return;
+	it->second.client_fd = -1;
+	it->second.body.size = it->second.body.offset;
+	appendRecord(FCGI_ABORT_REQUEST, id, NULL, 0);
+	fillStdin();
+}
+
+void FastCgiConnection::finish(unsigned short id)
+{
+	std::map<unsigned short, FastCgiRequest>::iterator it = requests.find(id);
+	if (it == requests.end())
+		return;
+	if (it->second.body.fd != -1)
+		close(it->second.body.fd);
+	requests.erase(it);
+}
+
+/**
+ * @brief Encode pending request bodies, keeping little more than FCGI_STDIN_QUEUE in memory.
+ */
+void FastCgiConnection::fillStdin()
+{
+	if (_out_pos > FCGI_STDIN_QUEUE)
+	{
+		// Drop what was sent so a long body does not grow the buffer
+		_out.erase(0, _out_pos);
+		_out_pos = 0;
+	}
+	std::map<unsigned short, FastCgiRequest>::iterator it;
+	for (it = requests.begin(); it != requests.end(); ++it)
+	{
+		FastCgiRequest &req = it->second;
+		FastCgiBody &body = req.body;
+		while (!req.stdin_done && _out.size() - _out_pos < FCGI_STDIN_QUEUE)
+		{
+			size_t left = body.size - body.offset;
+			size_t len = left < FCGI_CHUNK ? left : FCGI_CHUNK;
+			if (len == 0)
+			{
+				appendRecord(FCGI_STDIN, it->first, NULL, 0);
+				req.stdin_done = true;
+				if (body.fd != -1)
+					close(body.fd);
+				body.fd = -1;
+				body.data.clear();
+			}
+			else if (body.fd != -1)
+			{
+				char buffer[FCGI_CHUNK];
+				ssize_t n = pread(body.fd, buffer, len, body.offset);
+				if (n <= 0)
+					body.size = body.offset; // Spool file vanished: end the stream
+				else
+				{
+					appendRecord(FCGI_STDIN, it->first, buffer, n);
+					body.offset += n;
+				}
+			}
+			else
+			{
+				appendRecord(FCGI_STDIN, it->first, body.data.data() + body.offset, len);
+				body.offset += len;
+			}
+		}
+	}
+}
+
+bool FastCgiConnection::hasOutput() const { return _out_pos < _out.size(); }
+
+bool FastCgiConnection::flush()
+{
+	while (_out_pos < _out.size())
+	{
+		ssize_t sent = send(fd, _out.data() + _out_pos, _out.size() - _out_pos, 0);
+		if (sent < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		_out_pos += sent;
+		if (_out_pos == _out.size())
+		{
+			_out.clear();
+			_out_pos = 0;
+			fillStdin();
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Read what the backend sent and split it into complete records.
+ */
+bool FastCgiConnection::receive(std::vector<FastCgiRecord> &records)
+{
+	records.clear();
+	char buffer[65536];
+	ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+	if (n < 0)
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR; // Nothing yet, no records
+	if (n == 0)
+		return false;
+	_in.append(buffer, n);
+
+	size_t pos = 0;
+	while (_in.size() - pos >= 8)
+	{
+		const unsigned char *header = (const unsigned char *)_in.data() + pos;
+		if (header[0] != 1)
+			return false;
+		size_t len = (header[4] << 8) | header[5];
+		size_t total = 8 + len + header[6];
+		if (_in.size() - pos < total)
+			break;
+		FastCgiRecord record;
+		record.type = header[1];
+		record.request_id = (header[2] << 8) | header[3];
+		record.content.assign(_in, pos + 8, len);
+		records.push_back(record);
+		pos += total;
+	}
+	_in.erase(0, pos);
+	return true;
+}
+
+void FastCgiConnection::release()
+{
+	std::map<unsigned short, FastCgiRequest>::iterator it;
+	for (it = requests.begin(); it != requests.end(); ++it)
+	{
+		if (it->second.body.fd != -1)
+			close(it->second.body.fd);
+	}
+	requests.clear();
+}
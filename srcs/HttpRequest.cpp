@@ -1,58 +1,236 @@
 #include "../includes/HttpRequest.hpp"
+#include "../includes/Log.hpp"
+#include "../includes/Scanner.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cerrno>
+#include <fstream>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <strings.h>
 
 /**
  * @class HttpRequest
  * @brief Represents and parses an HTTP request, supporting both standard and chunked transfer encoding.
  */
 
+// Upper bound for the request line + header block
+static const size_t MAX_HEADER_BLOCK = 64 * 1024;
+
+// Consumed body bytes tolerated in front of unparsed data before compacting
+static const size_t COMPACT_THRESHOLD = 64 * 1024;
+
+// Lowercase names of the KnownHeader slots, in enum order
+static const char *const known_headers[HEADER_COUNT] = {
+	"host", "content-length", "transfer-encoding", "connection", "content-type",
+	"range", "if-none-match", "if-modified-since", "accept-encoding", "expect"};
+
+// Compare 'len' bytes with a lowercase name, ignoring ASCII case
+static bool equalsLower(const char *data, const char *lower, size_t len)
+{
+	for (size_t i = 0; i < len; ++i)
+	{
+		char c = data[i];
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		if (c != lower[i])
+			return false;
+	}
+	return true;
+}
+
 /**
  * @brief Construct a new HttpRequest object and initialize its state.
  */
 HttpRequest::HttpRequest()
-	: _state(STATE_REQUEST_LINE), _content_length(0), _chunk_length(0), _is_chunk_size(true) {}
+	: _state(STATE_REQUEST_LINE), _pos(0), _scan(0), _head_end(0), _error_code(0), _limits_set(false),
+	  _max_body_size(0), _body_buffer_size(0), _body_size(0), _body_fd(-1), _content_length(0),
+	  _chunk_length(0), _is_chunk_size(true), _in_trailer(false)
+{
+	std::fill(_known, _known + HEADER_COUNT, -1);
+}
+
+/**
+ * @brief Destroy the HttpRequest object, removing a spooled body file if any.
+ */
+HttpRequest::~HttpRequest()
+{
+	discardBodyFile();
+}
 
 /**
- * @brief Destroy the HttpRequest object.
+ * @brief Copy the parse state. A spooled body file stays owned by 'other'.
  */
-HttpRequest::~HttpRequest() {}
+HttpRequest::HttpRequest(const HttpRequest &other) : _body_fd(-1)
+{
+	*this = other;
+}
+
+HttpRequest &HttpRequest::operator=(const HttpRequest &other)
+{
+	if (this == &other)
+		return *this;
+	discardBodyFile();
+	_state = other._state;
+	_buffer = other._buffer;
+	_pos = other._pos;
+	_scan = other._scan;
+	_head_end = other._head_end;
+	_method = other._method;
+	_path = other._path;
+	_version = other._version;
+	_headers = other._headers;
+	std::copy(other._known, other._known + HEADER_COUNT, _known);
+	for (int i = 0; i < HEADER_COUNT; ++i)
+		_known_values[i] = other._known_values[i];
+	_body = other._body;
+	_error_code = other._error_code;
+	_limits_set = other._limits_set;
+	_max_body_size = other._max_body_size;
+	_body_buffer_size = other._body_buffer_size;
+	_temp_dir = other._temp_dir;
+	_body_size = other._body_fd == -1 ? other._body_size : 0;
+	_content_length = other._content_length;
+	_chunk_length = other._chunk_length;
+	_is_chunk_size = other._is_chunk_size;
+	_in_trailer = other._in_trailer;
+	return *this;
+}
 
 /**
  * @brief Reset the HttpRequest object to its initial state for reuse (e.g., for keep-alive connections).
  *
- * This function clears all parsed data, including method, path, version, headers, body, and buffer.
+ * This function clears all parsed data, including method, path, version, headers and body.
  * It also resets the content length, chunk length, and chunk size indicator.
+ * Bytes already received for a following pipelined request stay in the buffer,
+ * and buffer capacity is kept, so the next request does not reallocate.
  */
 void HttpRequest::reset()
 {
 	_state = STATE_REQUEST_LINE;
-	_method.clear();
-	_path.clear();
-	_version.clear();
+	_buffer.erase(0, _pos);
+	_pos = 0;
+	_scan = 0;
+	_head_end = 0;
+	_method = Slice();
+	_path = Slice();
+	_version = Slice();
 	_headers.clear();
+	for (int i = 0; i < HEADER_COUNT; ++i)
+	{
+		if (_known[i] != -1)
+			_known_values[i].clear(); // Capacity stays for the next request
+		_known[i] = -1;
+	}
 	_body.clear();
-	_buffer.clear();
+	_error_code = 0;
+	_limits_set = false;
+	_body_size = 0;
+	discardBodyFile();
 	_content_length = 0;
 	_chunk_length = 0;
 	_is_chunk_size = true;
+	_in_trailer = false;
+}
+
+/**
+ * @brief Empty the request for another connection.
+ *
+ * Unlike reset(), pipelined bytes are dropped as well. Header and body
+ * buffers within 'keep_capacity' keep their memory for the next
+ * connection; the input buffer is left to the pool, see swapBuffer().
+ */
+void HttpRequest::clear(size_t keep_capacity)
+{
+	_pos = _buffer.size();
+	reset();
+	if (_body.capacity() > keep_capacity)
+		std::string().swap(_body);
+	if (_headers.capacity() > keep_capacity / sizeof(HeaderField))
+		std::vector<HeaderField>().swap(_headers);
+}
+
+void HttpRequest::swapBuffer(std::string &buffer)
+{
+	buffer.clear();
+	_buffer.swap(buffer);
+}
+
+std::string HttpRequest::sliceToString(const Slice &slice) const
+{
+	return _buffer.substr(slice.offset, slice.length);
 }
 
 /**
  * @brief Get the HTTP method (e.g., GET, POST).
  * @return The HTTP method as a string.
  */
-std::string HttpRequest::getMethod() const { return _method; }
+std::string HttpRequest::getMethod() const { return sliceToString(_method); }
 
 /**
  * @brief Get the requested path from the HTTP request line.
  * @return The request path as a string.
  */
-std::string HttpRequest::getPath() const { return _path; }
+std::string HttpRequest::getPath() const { return sliceToString(_path); }
+std::string HttpRequest::getVersion() const { return sliceToString(_version); }
+
+/**
+ * @brief Get the in-memory body of the HTTP request.
+ * @return The request body, or an empty string if it was spooled to a file.
+ */
+const std::string &HttpRequest::getBody() const { return _body; }
+
+/**
+ * @brief Get the number of body bytes received (decoded for chunked bodies).
+ */
+size_t HttpRequest::getBodySize() const { return _body_size; }
+
+/**
+ * @brief Check whether the body outgrew the memory buffer and lives in a temp file.
+ */
+bool HttpRequest::isBodyInFile() const { return _body_fd != -1; }
+
+/**
+ * @brief Get the fd of the spooled body file, or -1.
+ */
+int HttpRequest::getBodyFd() const { return _body_fd; }
+
+/**
+ * @brief Get the HTTP status of a parse error (400 malformed, 413 body too large,
+ * 431 header block too large), 0 if none.
+ */
+int HttpRequest::getErrorCode() const { return _error_code; }
+
+/**
+ * @brief Check whether parsing stopped after the headers, waiting for setBodyLimits().
+ */
+bool HttpRequest::needsBodyLimits() const
+{
+	return !_limits_set && (_state == STATE_BODY || _state == STATE_CHUNKED);
+}
 
 /**
- * @brief Get the body of the HTTP request.
- * @return The request body as a string.
+ * @brief Configure the body sink for the matched server block.
+ *
+ * A declared Content-Length above the limit fails right away; chunked
+ * bodies are checked as every chunk arrives.
+ *
+ * @param max_body_size client_max_body_size in bytes.
+ * @param buffer_size Bytes kept in memory before spooling to a temp file.
+ * @param temp_dir Directory for spooled bodies.
  */
-std::string HttpRequest::getBody() const { return _body; }
+void HttpRequest::setBodyLimits(size_t max_body_size, size_t buffer_size, const std::string &temp_dir)
+{
+	_limits_set = true;
+	_max_body_size = max_body_size;
+	_body_buffer_size = buffer_size;
+	_temp_dir = temp_dir;
+	if (_state == STATE_BODY && _content_length > _max_body_size)
+		fail(413);
+}
 
 /**
  * @brief Check if the HTTP request has been fully parsed.
@@ -61,18 +239,135 @@ std::string HttpRequest::getBody() const { return _body; }
 bool HttpRequest::isFinished() const { return _state == STATE_COMPLETE; }
 
 /**
- * @brief Get the value of a specific HTTP header.
- * @param key The header name.
+ * @brief Check whether any byte of the next request was received (pipelined leftovers included).
+ */
+bool HttpRequest::hasStarted() const { return _state != STATE_REQUEST_LINE || _pos < _buffer.size(); }
+
+bool HttpRequest::isReadingBody() const { return _state == STATE_BODY || _state == STATE_CHUNKED; }
+
+// 'option' is one of the comma separated, case-insensitive items of 'list'
+static bool hasOption(const std::string &list, const char *option)
+{
+	size_t len = std::strlen(option);
+	size_t pos = 0;
+	while (pos <= list.size())
+	{
+		size_t end = list.find(',', pos);
+		if (end == std::string::npos)
+			end = list.size();
+		size_t first = pos;
+		while (first < end && (list[first] == ' ' || list[first] == '\t'))
+			++first;
+		size_t last = end;
+		while (last > first && (list[last - 1] == ' ' || list[last - 1] == '\t'))
+			--last;
+		if (last - first == len && strncasecmp(list.data() + first, option, len) == 0)
+			return true;
+		pos = end + 1;
+	}
+	return false;
+}
+
+/**
+ * @brief HTTP/1.1 connections persist unless the client sends "Connection:
+ * close"; HTTP/1.0 ones only when it sends "Connection: keep-alive".
+ */
+bool HttpRequest::keepAlive() const
+{
+	const std::string &connection = getHeader(HEADER_CONNECTION);
+	if (_version.length == 8 && _buffer.compare(_version.offset, 8, "HTTP/1.0") == 0)
+		return hasOption(connection, "keep-alive");
+	return !hasOption(connection, "close");
+}
+
+/**
+ * @brief Find a header field by name, ignoring case; the last occurrence wins.
+ */
+const HeaderField *HttpRequest::findHeader(const char *name) const
+{
+	size_t name_len = std::strlen(name);
+	for (size_t i = _headers.size(); i > 0; --i)
+	{
+		const HeaderField &field = _headers[i - 1];
+		if (field.name.length == name_len && strncasecmp(_buffer.data() + field.name.offset, name, name_len) == 0)
+			return &field;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Get a header the parser classified, without searching or copying.
+ * @return The value, or an empty string if the header is absent.
+ */
+const std::string &HttpRequest::getHeader(KnownHeader header) const
+{
+	return _known_values[header];
+}
+
+/**
+ * @brief Get the value of any HTTP header.
+ * @param key The header name, matched case-insensitively.
  * @return The header value, or an empty string if not found.
  */
 std::string HttpRequest::getHeader(const std::string &key) const
 {
-	std::map<std::string, std::string>::const_iterator it = _headers.find(key);
-	if (it != _headers.end())
-		return it->second;
+	const HeaderField *field = findHeader(key.c_str());
+	if (field)
+		return sliceToString(field->value);
 	return "";
 }
 
+/**
+ * @brief Point the slot of a known header at _headers[index].
+ *
+ * The name length picks the only candidates, so most fields are rejected
+ * without comparing a byte.
+ */
+void HttpRequest::classifyHeader(size_t index)
+{
+	const Slice &name = _headers[index].name;
+	KnownHeader first = HEADER_COUNT;
+	KnownHeader second = HEADER_COUNT;
+	switch (name.length)
+	{
+	case 4:
+		first = HEADER_HOST;
+		break;
+	case 5:
+		first = HEADER_RANGE;
+		break;
+	case 6:
+		first = HEADER_EXPECT;
+		break;
+	case 10:
+		first = HEADER_CONNECTION;
+		break;
+	case 12:
+		first = HEADER_CONTENT_TYPE;
+		break;
+	case 13:
+		first = HEADER_IF_NONE_MATCH;
+		break;
+	case 14:
+		first = HEADER_CONTENT_LENGTH;
+		break;
+	case 15:
+		first = HEADER_ACCEPT_ENCODING;
+		break;
+	case 17:
+		first = HEADER_TRANSFER_ENCODING;
+		second = HEADER_IF_MODIFIED_SINCE;
+		break;
+	default:
+		return;
+	}
+	const char *data = _buffer.data() + name.offset;
+	if (equalsLower(data, known_headers[first], name.length))
+		_known[first] = index; // Later duplicates replace earlier ones
+	else if (second != HEADER_COUNT && equalsLower(data, known_headers[second], name.length))
+		_known[second] = index;
+}
+
 /**
  * @brief Parse incoming raw data and update the request state.
  *
@@ -82,7 +377,18 @@ std::string HttpRequest::getHeader(const std::string &key) const
  */
 bool HttpRequest::parse(const std::string &raw_data)
 {
-	_buffer += raw_data;
+	return parse(raw_data.data(), raw_data.size());
+}
+
+/**
+ * @brief Parse incoming raw data without an intermediate std::string.
+ * @param data The incoming bytes.
+ * @param len Number of bytes in data.
+ * @return True if the request is fully parsed, false otherwise.
+ */
+bool HttpRequest::parse(const char *data, size_t len)
+{
+	_buffer.append(data, len);
 
 	if (_state == STATE_REQUEST_LINE)
 	{
@@ -92,6 +398,10 @@ bool HttpRequest::parse(const std::string &raw_data)
 	{
 		parseHeaders();
 	}
+	if (needsBodyLimits())
+	{
+		return false;
+	}
 	if (_state == STATE_BODY)
 	{
 		parseBody();
@@ -100,10 +410,58 @@ bool HttpRequest::parse(const std::string &raw_data)
 	{
 		parseChunkedBody();
 	}
+	compact();
 
 	return _state == STATE_COMPLETE;
 }
 
+/**
+ * @brief Find the next CRLF at or after _pos.
+ *
+ * The search resumes where the previous one stopped, so a line that
+ * arrives in many small pieces is scanned only once.
+ * @return Offset of the '\r', or std::string::npos if no full line is buffered.
+ */
+size_t HttpRequest::findLineEnd()
+{
+	if (_scan < _pos)
+		_scan = _pos;
+	const char *data = _buffer.data();
+	while (_scan < _buffer.size())
+	{
+		size_t lf = _scan + Scanner::findLineFeed(data + _scan, _buffer.size() - _scan);
+		if (lf == _buffer.size())
+		{
+			_scan = lf;
+			return std::string::npos;
+		}
+		_scan = lf + 1;
+		if (lf > _pos && data[lf - 1] == '\r')
+			return lf - 1;
+	}
+	return std::string::npos;
+}
+
+/**
+ * @brief Drop consumed body bytes once enough of them piled up.
+ *
+ * The header block in front is kept so the slices stay valid; a fully
+ * consumed buffer is simply truncated back to it.
+ */
+void HttpRequest::compact()
+{
+	if (_head_end == 0 || _pos == _head_end)
+		return;
+	if (_pos == _buffer.size())
+		_buffer.resize(_head_end);
+	else if (_pos - _head_end >= COMPACT_THRESHOLD)
+		_buffer.erase(_head_end, _pos - _head_end);
+	else
+		return;
+	_scan = _scan > _pos ? _scan - (_pos - _head_end) : _head_end;
+	_pos = _head_end;
+}
+
 /**
  * @brief Parse the HTTP request line (e.g., "GET /path HTTP/1.1").
  *
@@ -112,20 +470,33 @@ bool HttpRequest::parse(const std::string &raw_data)
  */
 void HttpRequest::parseRequestLine()
 {
-	size_t pos = _buffer.find("\r\n");
-	if (pos == std::string::npos)
+	size_t end = findLineEnd();
+	if (end == std::string::npos)
+	{
+		if (_buffer.size() - _pos > MAX_HEADER_BLOCK)
+			fail(431);
 		return;
+	}
 
-	std::string line = _buffer.substr(0, pos);
-	_buffer.erase(0, pos + 2);
-
-	std::stringstream ss(line);
-	ss >> _method >> _path >> _version;
+	// Three whitespace separated tokens: method, path, version
+	const char *data = _buffer.data();
+	Slice *tokens[3] = {&_method, &_path, &_version};
+	size_t i = _pos;
+	for (int t = 0; t < 3; ++t)
+	{
+		while (i < end && (data[i] == ' ' || data[i] == '\t'))
+			++i;
+		size_t start = i;
+		i += Scanner::findBlank(data + i, end - i);
+		*tokens[t] = Slice(start, i - start);
+	}
+	_pos = end + 2;
 
-	if (_method.empty() || _path.empty() || _version.empty())
+	if (_method.length == 0 || _path.length == 0 || _version.length == 0 ||
+		Scanner::tokenLength(data + _method.offset, _method.length) != _method.length)
 	{
-		std::cerr << "Error: Malformed request line" << std::endl;
-		_state = STATE_COMPLETE;
+		LOG(LEVEL_INFO, "Malformed request line");
+		fail(400);
 		return;
 	}
 	_state = STATE_HEADERS;
@@ -139,17 +510,25 @@ void HttpRequest::parseRequestLine()
  */
 void HttpRequest::parseHeaders()
 {
-	size_t pos;
-	while ((pos = _buffer.find("\r\n")) != std::string::npos)
+	size_t end;
+	while ((end = findLineEnd()) != std::string::npos)
 	{
-		if (pos == 0)
+		if (end == _pos)
 		{
-			_buffer.erase(0, 2); // End of headers
+			_pos += 2; // End of headers
+			_head_end = _pos;
+
+			// Copy the known headers once, into strings reused across requests
+			for (int i = 0; i < HEADER_COUNT; ++i)
+			{
+				if (_known[i] != -1)
+					_known_values[i].assign(_buffer, _headers[_known[i]].value.offset, _headers[_known[i]].value.length);
+			}
 
 			// Determine next state
-			if (_headers.count("Content-Length"))
+			if (_known[HEADER_CONTENT_LENGTH] != -1)
 			{
-				_content_length = std::atoi(_headers["Content-Length"].c_str());
+				_content_length = std::strtoul(_known_values[HEADER_CONTENT_LENGTH].c_str(), NULL, 10);
 				if (_content_length > 0)
 				{
 					_state = STATE_BODY;
@@ -159,7 +538,7 @@ void HttpRequest::parseHeaders()
 					_state = STATE_COMPLETE;
 				}
 			}
-			else if (_headers.count("Transfer-Encoding") && _headers["Transfer-Encoding"] == "chunked")
+			else if (strcasecmp(_known_values[HEADER_TRANSFER_ENCODING].c_str(), "chunked") == 0)
 			{
 				_state = STATE_CHUNKED;
 			}
@@ -170,87 +549,259 @@ void HttpRequest::parseHeaders()
 			return;
 		}
 
-		std::string line = _buffer.substr(0, pos);
-		_buffer.erase(0, pos + 2);
-
-		size_t colon = line.find(':');
-		if (colon != std::string::npos)
+		// field-name is a token ended by ':', with no whitespace before it
+		const char *line = _buffer.data() + _pos;
+		size_t name_length = Scanner::tokenLength(line, end - _pos);
+		if (name_length > 0 && line[name_length] == ':')
+		{
+			HeaderField field;
+			field.name = Slice(_pos, name_length);
+			size_t value = _pos + name_length + 1;
+			while (value < end && _buffer[value] == ' ')
+				++value;
+			field.value = Slice(value, end - value);
+			_headers.push_back(field);
+			classifyHeader(_headers.size() - 1);
+		}
+		else if (std::memchr(line, ':', end - _pos))
 		{
-			std::string key = line.substr(0, colon);
-			std::string value = line.substr(colon + 1);
-			while (!value.empty() && value[0] == ' ')
-				value.erase(0, 1);
-			_headers[key] = value;
+			// Bad name byte, whitespace before the colon or a folded line
+			LOG(LEVEL_INFO, "Malformed header field name");
+			fail(400);
+			return;
 		}
+		_pos = end + 2;
 	}
+	if (_buffer.size() > MAX_HEADER_BLOCK)
+		fail(431);
 }
 
 /**
  * @brief Parse the request body based on Content-Length.
  *
- * Reads the specified number of bytes from the buffer into the body.
+ * Moves whatever part of the body has arrived into the body sink.
  * Sets the state to STATE_COMPLETE when done.
  */
 void HttpRequest::parseBody()
 {
-	if (_buffer.size() >= _content_length)
-	{
-		_body = _buffer.substr(0, _content_length);
-		_buffer.erase(0, _content_length);
+	size_t len = _content_length - _body_size;
+	if (len > _buffer.size() - _pos)
+		len = _buffer.size() - _pos;
+	if (!appendBody(_buffer.data() + _pos, len))
+		return;
+	_pos += len;
+	if (_body_size == _content_length)
 		_state = STATE_COMPLETE;
-	}
 }
 
 /**
  * @brief Parse a chunked transfer-encoded HTTP request body.
  *
  * Reads chunks of data according to the chunked transfer encoding rules.
- * Sets the state to STATE_COMPLETE when the final chunk is received.
+ * Sets the state to STATE_COMPLETE when the final chunk and its trailer are received.
  */
 void HttpRequest::parseChunkedBody()
 {
 	while (true)
 	{
-		if (_is_chunk_size)
+		if (_in_trailer)
 		{
-			// 1. Expecting <Hex Size>\r\n
-			size_t pos = _buffer.find("\r\n");
-			if (pos == std::string::npos)
+			// 3. Optional trailer fields, ended by an empty line
+			size_t end = findLineEnd();
+			if (end == std::string::npos)
+				return;
+			bool last = (end == _pos);
+			_pos = end + 2;
+			if (last)
+			{
+				_state = STATE_COMPLETE;
+				return;
+			}
+		}
+		else if (_is_chunk_size)
+		{
+			// 1. Expecting <Hex Size>[;extensions]\r\n
+			size_t end = findLineEnd();
+			if (end == std::string::npos)
 				return; // Wait for more data
 
-			std::string line = _buffer.substr(0, pos);
-			_buffer.erase(0, pos + 2);
-
-			// Parse Hex
-			std::stringstream ss;
-			ss << std::hex << line;
-			ss >> _chunk_length;
-
-			if (_chunk_length == 0)
+			size_t i = _pos;
+			size_t size = 0;
+			for (; i < end && std::isxdigit(static_cast<unsigned char>(_buffer[i])); ++i)
 			{
-				// End of chunks. Consume trailing CRLF
-				if (_buffer.substr(0, 2) == "\r\n" && _buffer.size() >= 2)
+				if (size > (static_cast<size_t>(-1) >> 4))
 				{
-					_buffer.erase(0, 2);
+					fail(413);
+					return;
 				}
-				_state = STATE_COMPLETE;
+				char c = std::tolower(_buffer[i]);
+				size = size * 16 + (c <= '9' ? c - '0' : c - 'a' + 10);
+			}
+			if (i == _pos)
+			{
+				fail(400);
+				return;
+			}
+			_pos = end + 2;
+			_chunk_length = size;
+
+			if (_chunk_length == 0)
+			{
+				// End of chunks, the trailer section follows
+				_in_trailer = true;
+				continue;
+			}
+			// Enforce the limit before any byte of this chunk is buffered
+			if (_chunk_length > _max_body_size - _body_size)
+			{
+				fail(413);
 				return;
 			}
 			_is_chunk_size = false; // Next step: Read data
 		}
 		else
 		{
-			// 2. Expecting <Data>\r\n
-			// We need to wait until we have the full chunk + CRLF
-			if (_buffer.size() < _chunk_length + 2)
+			// 2. Expecting <Data>\r\n, streamed as it arrives
+			size_t len = _buffer.size() - _pos;
+			if (len > _chunk_length)
+				len = _chunk_length;
+			if (!appendBody(_buffer.data() + _pos, len))
 				return;
-
-			// Extract data
-			_body += _buffer.substr(0, _chunk_length);
-			_buffer.erase(0, _chunk_length + 2); // Remove data + CRLF
+			_pos += len;
+			_chunk_length -= len;
+			if (_chunk_length > 0 || _buffer.size() - _pos < 2)
+				return; // Wait for the rest of the chunk or its CRLF
+			_pos += 2;
 
 			// Reset to read next chunk size
 			_is_chunk_size = true;
 		}
 	}
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Add body bytes to memory or, past the buffer size, to the temp file.
+ * @return False if the body could not be stored (request failed with 500).
+ */
+bool HttpRequest::appendBody(const char *data, size_t len)
+{
+	if (len == 0)
+		return true;
+	if (_body_fd == -1 && _body.size() + len > _body_buffer_size && !spillBody())
+		return false;
+
+	if (_body_fd == -1)
+		_body.append(data, len);
+	else
+	{
+		size_t done = 0;
+		while (done < len)
+		{
+			ssize_t n = write(_body_fd, data + done, len - done);
+			if (n <= 0)
+			{
+				fail(500);
+				return false;
+			}
+			done += n;
+		}
+	}
+	_body_size += len;
+	return true;
+}
+
+/**
+ * @brief Move the in-memory body into a new temp file under _temp_dir.
+ */
+bool HttpRequest::spillBody()
+{
+	std::string tmpl = _temp_dir + "/webserv_body_XXXXXX";
+	std::vector<char> path(tmpl.begin(), tmpl.end());
+	path.push_back('\0');
+	_body_fd = mkstemp(&path[0]);
+	if (_body_fd == -1)
+	{
+		perror("mkstemp");
+		fail(500);
+		return false;
+	}
+	fcntl(_body_fd, F_SETFD, FD_CLOEXEC);
+	_body_path = &path[0];
+
+	std::string pending;
+	pending.swap(_body); // Also releases the memory buffer
+	_body_size -= pending.size();
+	return appendBody(pending.data(), pending.size());
+}
+
+/**
+ * @brief Close and delete the spooled body file, if any.
+ */
+void HttpRequest::discardBodyFile()
+{
+	if (_body_fd == -1)
+		return;
+	close(_body_fd);
+	unlink(_body_path.c_str());
+	_body_fd = -1;
+	_body_path.clear();
+}
+
+/**
+ * @brief Stop parsing: the request is answered with 'error_code'.
+ */
+void HttpRequest::fail(int error_code)
+{
+	_error_code = error_code;
+	_state = STATE_COMPLETE;
+}
+
+/**
+ * @brief Store the body at 'path'.
+ *
+ * A spooled body is renamed into place (copied across file systems),
+ * so large uploads are never read back into memory.
+ */
+bool HttpRequest::saveBody(const std::string &path)
+{
+	if (_body_fd == -1)
+	{
+		std::ofstream outfile(path.c_str(), std::ios::binary);
+		if (!outfile.is_open())
+			return false;
+		outfile.write(_body.data(), _body.size());
+		return outfile.good();
+	}
+
+	// mkstemp() made the file 0600: give it the mode a file written in memory gets
+	mode_t mask = umask(0);
+	umask(mask);
+	fchmod(_body_fd, 0666 & ~mask);
+	if (rename(_body_path.c_str(), path.c_str()) == 0)
+	{
+		close(_body_fd);
+		_body_fd = -1;
+		_body_path.clear();
+		return true;
+	}
+	if (errno != EXDEV)
+		return false;
+
+	int out = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (out < 0)
+		return false;
+	char buf[65536];
+	off_t offset = 0;
+	ssize_t n;
+	while ((n = pread(_body_fd, buf, sizeof(buf), offset)) > 0)
+	{
+		if (write(out, buf, n) != n)
+		{
+			close(out);
+			return false;
+		}
+		offset += n;
+	}
+	close(out);
+	return n == 0;
+}
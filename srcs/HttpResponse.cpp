@@ -1,385 +1,1005 @@
-#include "../includes/HttpResponse.hpp"
-#include <ctime>
-#include <dirent.h>
-#include <unistd.h>
-#include <sys/wait.h>
-#include <cstring>
-#include <cstdlib>
-
-// Helper to convert int to string
-static std::string toString(int i)
-{
-	std::stringstream ss;
-	ss << i;
-	return ss.str();
-}
-
-void HttpResponse::processRequest(Client &client, const std::vector<ServerConfig> &configs)
-{
-	const HttpRequest &req = client.request;
-	const ServerConfig *server_config = findMatchingServer(req, configs, client.listening_port);
-
-	// 1. Check Payload Size
-	std::cout << "Debug: Body Size=" << req.getBody().size()
-			  << " Max=" << (server_config ? server_config->client_max_body_size : 0) << std::endl;
-	if (server_config && req.getBody().size() > server_config->client_max_body_size)
-	{
-		client.response_buffer = buildErrorResponse(413, server_config);
-		client.is_ready_to_write = true;
-		return;
-	}
-
-	// 2. Routing
-	const LocationConfig *loc_config = NULL;
-	if (server_config)
-		loc_config = findMatchingLocation(*server_config, req.getPath());
-
-	if (!loc_config)
-	{
-		client.response_buffer = buildErrorResponse(404, server_config);
-		client.is_ready_to_write = true;
-		return;
-	}
-
-	// 3. Redirection
-	if (loc_config->return_code != 0)
-	{
-		client.response_buffer = buildRedirectResponse(loc_config->return_code, loc_config->return_path);
-		client.is_ready_to_write = true;
-		return;
-	}
-
-	// 4. Method Allowed Check
-	bool method_allowed = false;
-	if (loc_config->methods.empty())
-	{
-		if (req.getMethod() == "GET")
-			method_allowed = true;
-	}
-	else
-	{
-		for (size_t i = 0; i < loc_config->methods.size(); ++i)
-		{
-			if (loc_config->methods[i] == req.getMethod())
-			{
-				method_allowed = true;
-				break;
-			}
-		}
-	}
-	if (!method_allowed)
-	{
-		client.response_buffer = buildErrorResponse(405, server_config);
-		client.is_ready_to_write = true;
-		return;
-	}
-
-	// 5. Determine File Path
-	std::string request_path = req.getPath();
-	size_t q_pos = request_path.find('?');
-	if (q_pos != std::string::npos)
-		request_path = request_path.substr(0, q_pos);
-
-	std::string filepath = loc_config->root + request_path;
-	struct stat st;
-	if (stat(filepath.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && !loc_config->index.empty())
-	{
-		filepath += "/" + loc_config->index;
-	}
-
-	// 6. Handle CGI
-	if (isCgiRequest(*loc_config, filepath))
-	{
-		handleCgiRequest(client, *loc_config, filepath);
-		return; // Return immediately (Async)
-	}
-
-	// 7. Handle Static
-	std::string response;
-	if (req.getMethod() == "GET")
-	{
-		response = handleGetRequest(*loc_config, req.getPath());
-	}
-	else if (req.getMethod() == "DELETE")
-	{
-		response = handleDeleteRequest(*loc_config, req.getPath());
-	}
-	else if (req.getMethod() == "POST")
-	{
-		response = handlePostRequest(*loc_config, req);
-	}
-	else
-	{
-		response = buildErrorResponse(501, server_config);
-	}
-
-	client.response_buffer = response;
-	client.is_ready_to_write = true;
-}
-
-void HttpResponse::handleCgiRequest(Client &client, const LocationConfig &loc_config, const std::string &script_path)
-{
-	(void)loc_config;
-	const HttpRequest &req = client.request;
-
-	// Setup Env
-	std::vector<std::string> env_vars;
-	std::string uri = req.getPath();
-	std::string query_string = "";
-	size_t q_pos = uri.find('?');
-	if (q_pos != std::string::npos)
-	{
-		query_string = uri.substr(q_pos + 1);
-		uri = uri.substr(0, q_pos);
-	}
-	env_vars.push_back("REQUEST_METHOD=" + req.getMethod());
-	env_vars.push_back("QUERY_STRING=" + query_string);
-	env_vars.push_back("SCRIPT_FILENAME=" + script_path);
-	env_vars.push_back("PATH_INFO=" + uri);
-	env_vars.push_back("SERVER_PROTOCOL=HTTP/1.1");
-	if (!req.getHeader("Content-Length").empty())
-		env_vars.push_back("CONTENT_LENGTH=" + req.getHeader("Content-Length"));
-	env_vars.push_back("CONTENT_TYPE=" + req.getHeader("Content-Type"));
-	env_vars.push_back("REDIRECT_STATUS=200");
-
-	std::vector<char *> envp;
-	for (size_t i = 0; i < env_vars.size(); ++i)
-		envp.push_back(const_cast<char *>(env_vars[i].c_str()));
-	envp.push_back(NULL);
-
-	int pipe_in[2], pipe_out[2];
-	if (pipe(pipe_in) == -1 || pipe(pipe_out) == -1)
-	{
-		client.response_buffer = buildErrorResponse(500, NULL);
-		client.is_ready_to_write = true;
-		return;
-	}
-
-	pid_t pid = fork();
-	if (pid == -1)
-	{
-		close(pipe_in[0]);
-		close(pipe_in[1]);
-		close(pipe_out[0]);
-		close(pipe_out[1]);
-		client.response_buffer = buildErrorResponse(500, NULL);
-		client.is_ready_to_write = true;
-		return;
-	}
-
-	if (pid == 0)
-	{ // Child
-		close(pipe_in[1]);
-		close(pipe_out[0]);
-		dup2(pipe_in[0], STDIN_FILENO);
-		dup2(pipe_out[1], STDOUT_FILENO);
-		close(pipe_in[0]);
-		close(pipe_out[1]);
-
-		char *argv[] = {const_cast<char *>(script_path.c_str()), NULL};
-
-		execve(script_path.c_str(), argv, envp.data());
-
-		// If we reach here, execve failed!
-		perror("execve failed"); // <--- Prints the exact error (e.g. Permission denied, No such file)
-		std::cerr << "Failed to execute: " << script_path << std::endl;
-
-		exit(1);
-	}
-	else
-	{ // Parent
-		close(pipe_in[0]);
-		close(pipe_out[1]);
-
-		// Write Body to CGI (Simple blocking write for now)
-		if (!req.getBody().empty())
-		{
-			write(pipe_in[1], req.getBody().c_str(), req.getBody().size());
-		}
-		close(pipe_in[1]);
-
-		// Set Client State for Async polling
-		client.is_cgi_active = true;
-		client.cgi_pid = pid;
-		client.cgi_pipe_out = pipe_out[0]; // Read end
-		client.cgi_output_buffer.clear();
-
-		client.cgi_start_time = time(NULL);
-	}
-}
-
-std::string HttpResponse::buildCgiResponse(const std::string &cgi_output)
-{
-	size_t header_end = cgi_output.find("\r\n\r\n");
-	if (header_end == std::string::npos)
-	{
-		return buildResponseHeader(200, "OK", cgi_output.length(), "text/plain") + cgi_output;
-	}
-	std::string cgi_headers = cgi_output.substr(0, header_end);
-	std::string cgi_body = cgi_output.substr(header_end + 4);
-
-	std::stringstream ss;
-	ss << "HTTP/1.1 200 OK\r\n"
-	   << cgi_headers << "\r\nContent-Length: " << cgi_body.length() << "\r\n\r\n"
-	   << cgi_body;
-	return ss.str();
-}
-
-std::string HttpResponse::buildErrorResponse(int status_code, const ServerConfig *server_config)
-{
-	// Custom Error Page Check
-	if (server_config && server_config->error_pages.count(status_code))
-	{
-		std::string err_path = server_config->error_pages.at(status_code);
-		if (err_path[0] != '/')
-			err_path = server_config->root + "/" + err_path;
-
-		std::string content = getFileContent(err_path);
-		if (!content.empty())
-		{
-			return buildResponseHeader(status_code, "Error", content.length(), "text/html") + content;
-		}
-	}
-
-	// Default Fallback
-	std::string body = "<html><body><h1>Error " + toString(status_code) + "</h1></body></html>";
-	return buildResponseHeader(status_code, "Error", body.length(), "text/html") + body;
-}
-
-const ServerConfig *HttpResponse::findMatchingServer(const HttpRequest &req, const std::vector<ServerConfig> &configs, int client_port)
-{
-	(void)req;
-	for (size_t i = 0; i < configs.size(); ++i)
-	{
-		if (configs[i].port == client_port)
-			return &configs[i];
-	}
-	return configs.empty() ? NULL : &configs[0];
-}
-
-const LocationConfig *HttpResponse::findMatchingLocation(const ServerConfig &server, const std::string &path)
-{
-	const LocationConfig *best_match = NULL;
-	size_t best_match_length = 0;
-	for (size_t i = 0; i < server.locations.size(); ++i)
-	{
-		if (path.find(server.locations[i].path) == 0)
-		{
-			if (server.locations[i].path.length() > best_match_length)
-			{
-				best_match = &server.locations[i];
-				best_match_length = server.locations[i].path.length();
-			}
-		}
-	}
-	return best_match;
-}
-
-std::string HttpResponse::handleGetRequest(const LocationConfig &loc_config, const std::string &uri)
-{
-	std::string filepath = (uri == "/") ? loc_config.root + "/" + loc_config.index : loc_config.root + uri;
-
-	struct stat file_stat;
-	if (stat(filepath.c_str(), &file_stat) != 0)
-		return buildErrorResponse(404, NULL);
-
-	if (S_ISREG(file_stat.st_mode))
-	{
-		std::string content = getFileContent(filepath);
-		return buildResponseHeader(200, "OK", content.length(), getMimeType(filepath)) + content;
-	}
-	if (S_ISDIR(file_stat.st_mode))
-	{
-		if (loc_config.autoindex)
-		{
-			std::string listing = generateDirectoryListing(filepath, uri);
-			return buildResponseHeader(200, "OK", listing.length(), "text/html") + listing;
-		}
-		return buildErrorResponse(403, NULL);
-	}
-	return buildErrorResponse(403, NULL);
-}
-
-std::string HttpResponse::handlePostRequest(const LocationConfig &loc_config, const HttpRequest &req)
-{
-	std::string full_path = loc_config.root + req.getPath();
-	std::ofstream outfile(full_path.c_str(), std::ios::binary);
-	if (!outfile.is_open())
-		return buildErrorResponse(500, NULL);
-	outfile << req.getBody();
-	outfile.close();
-	std::string body = "File created";
-	return buildResponseHeader(201, "Created", body.length(), "text/plain") + body;
-}
-
-std::string HttpResponse::handleDeleteRequest(const LocationConfig &loc_config, const std::string &uri)
-{
-	std::string filepath = loc_config.root + uri;
-	if (std::remove(filepath.c_str()) != 0)
-		return buildErrorResponse(500, NULL);
-	return buildResponseHeader(204, "No Content", 0, "");
-}
-
-bool HttpResponse::isCgiRequest(const LocationConfig &loc_config, const std::string &path)
-{
-	if (loc_config.cgi_ext.empty())
-		return false;
-	size_t dot = path.rfind('.');
-	if (dot == std::string::npos)
-		return false;
-	std::string ext = path.substr(dot);
-	for (size_t i = 0; i < loc_config.cgi_ext.size(); ++i)
-		if (loc_config.cgi_ext[i] == ext)
-			return true;
-	return false;
-}
-
-std::string HttpResponse::getFileContent(const std::string &filepath)
-{
-	std::ifstream ifs(filepath.c_str());
-	if (!ifs.is_open())
-		return "";
-	std::stringstream buffer;
-	buffer << ifs.rdbuf();
-	return buffer.str();
-}
-
-std::string HttpResponse::getMimeType(const std::string &filepath)
-{
-	if (filepath.rfind(".html") != std::string::npos)
-		return "text/html";
-	if (filepath.rfind(".css") != std::string::npos)
-		return "text/css";
-	return "text/plain";
-}
-
-std::string HttpResponse::generateDirectoryListing(const std::string &dir_path, const std::string &uri)
-{
-	DIR *dir = opendir(dir_path.c_str());
-	if (!dir)
-		return "";
-	std::stringstream ss;
-	ss << "<html><body><h1>Index of " << uri << "</h1><hr><pre>";
-	struct dirent *entry;
-	while ((entry = readdir(dir)) != NULL)
-	{
-		ss << "<a href=\"" << entry->d_name << "\">" << entry->d_name << "</a><br>";
-	}
-	closedir(dir);
-	ss << "</pre></body></html>";
-	return ss.str();
-}
-
-std::string HttpResponse::buildResponseHeader(int status, const std::string &text, size_t len, const std::string &type)
-{
-	std::stringstream ss;
-	ss << "HTTP/1.1 " << status << " " << text << "\r\nContent-Type: " << type << "\r\nContent-Length: " << len << "\r\nConnection: keep-alive\r\n\r\n";
-	return ss.str();
-}
-
-std::string HttpResponse::buildRedirectResponse(int status, const std::string &loc)
-{
-	std::stringstream ss;
-	ss << "HTTP/1.1 " << status << " Found\r\nLocation: " << loc << "\r\nContent-Length: 0\r\n\r\n";
-	return ss.str();
+#include "../includes/HttpResponse.hpp"
+#include <ctime>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <cstring>
+#include <strings.h>
+#include <cctype>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+
+// Bodies up to this size are read into the header's segment: one writev(), no sendfile()
+static const off_t INLINE_BODY_MAX = 16 * 1024;
+
+// Complete the response of the current request; 'head' goes before any queued body
+static void reply(Client &client, const std::string &head)
+{
+	Response &res = client.responses.back();
+	res.out.prepend(head);
+	res.ready = true;
+}
+
+// Complete the response of the current request with a shared (cached) buffer
+static void reply(Client &client, const SharedBuffer &response)
+{
+	Response &res = client.responses.back();
+	res.out.appendShared(response);
+	res.ready = true;
+}
+
+// Helper to convert an integer (up to file sizes) to string
+static std::string toString(off_t i)
+{
+	std::stringstream ss;
+	ss << i;
+	return ss.str();
+}
+
+void HttpResponse::processRequest(Client &client, const Router &router, StaticCache &cache, StaticCache &gzip_cache,
+								  OpenFileCache &files, const Metrics &metrics)
+{
+	HttpRequest &req = client.request;
+	const ServerConfig *server_config = router.findServer(client.listening_port, req.getHeader(HEADER_HOST));
+
+	// 1. Parse errors (the body limit is enforced while the body arrives)
+	LOG_DEBUG("Body size " << req.getBodySize() << ", max "
+						   << (server_config ? server_config->client_max_body_size : 0));
+	if (req.getErrorCode() != 0)
+	{
+		// The rest of the request is unread: the connection cannot be reused
+		reply(client, buildErrorResponse(req.getErrorCode(), server_config, &files));
+		client.responses.back().close_after = true;
+		return;
+	}
+
+	// 2. Routing
+	Route route;
+	if (server_config)
+		route = router.findLocation(*server_config, req.getPath());
+	const LocationConfig *loc_config = route.location;
+	client.responses.back().route = route.id;
+
+	if (!loc_config)
+	{
+		reply(client, buildErrorResponse(404, server_config, &files));
+		return;
+	}
+
+	// 3. Redirection
+	if (loc_config->return_code != 0)
+	{
+		reply(client, buildRedirectResponse(loc_config->return_code, loc_config->return_path));
+		return;
+	}
+
+	// 4. Method Allowed Check (GET only without allow_methods)
+	if (!(route.methods & Router::methodBit(req.getMethod())))
+	{
+		reply(client, buildErrorResponse(405, server_config, &files));
+		return;
+	}
+
+	// 5. Metrics endpoint, never cached by anyone
+	if (loc_config->stub_status)
+	{
+		std::string body = metrics.render(router);
+		reply(client, buildResponseHeader(200, "OK", body.length(), "text/plain; version=0.0.4",
+										  "Cache-Control: no-store\r\n") +
+						  body);
+		return;
+	}
+
+	// 6. Determine File Path
+	std::string request_path = req.getPath();
+	size_t q_pos = request_path.find('?');
+	if (q_pos != std::string::npos)
+		request_path = request_path.substr(0, q_pos);
+
+	std::string filepath = loc_config->root + request_path;
+
+	// Compressed variants the client accepts; ranges always address the plain file
+	unsigned codings = 0;
+	if (req.getMethod() == "GET" && (loc_config->gzip || loc_config->gzip_static) && req.getHeader(HEADER_RANGE).empty())
+		codings = Compression::acceptedCodings(req.getHeader(HEADER_ACCEPT_ENCODING));
+
+	// Hot small assets are answered from memory, before any file syscall
+	if (req.getMethod() == "GET" && cache.isEnabled() && req.getHeader(HEADER_RANGE).empty() && !codings &&
+		!isConditional(req))
+	{
+		const CachedResponse *cached = cache.lookup(filepath);
+		if (cached)
+		{
+			reply(client, cached->response);
+			return;
+		}
+	}
+
+	std::string cache_key = filepath;
+	const OpenFile *file = &files.lookup(filepath);
+	if (file->err == 0 && S_ISDIR(file->st.st_mode) && !loc_config->index.empty())
+	{
+		// One separator, so the path matches a DELETE or POST of the index file itself
+		if (filepath[filepath.size() - 1] != '/')
+			filepath += "/";
+		filepath += loc_config->index;
+		file = &files.lookup(filepath);
+	}
+
+	// 7. Handle CGI
+	if (isCgiRequest(*loc_config, filepath))
+	{
+		if (!loc_config->fastcgi_pass.empty())
+			handleFastCgiRequest(client, *loc_config, filepath);
+		else
+			handleCgiRequest(client, *loc_config, filepath);
+		return; // Return immediately (Async)
+	}
+
+	// 8. Handle Static
+	std::string response;
+	if (req.getMethod() == "GET" && codings)
+	{
+		if (handleCompressedGet(client, *loc_config, *file, codings, gzip_cache, files))
+			return;
+		file = &files.lookup(filepath); // The sidecar lookups replaced the entry
+	}
+	if (req.getMethod() == "GET")
+	{
+		response = handleGetRequest(client, *loc_config, *file, request_path, cache, cache_key);
+	}
+	else if (req.getMethod() == "DELETE")
+	{
+		response = handleDeleteRequest(*loc_config, req.getPath());
+		files.forget(cache_key);
+		cache.forget(cache_key);
+		gzip_cache.forget(cache_key);
+	}
+	else if (req.getMethod() == "POST")
+	{
+		response = handlePostRequest(*loc_config, req);
+		files.forget(cache_key);
+		cache.forget(cache_key);
+		gzip_cache.forget(cache_key);
+	}
+	else
+	{
+		response = buildErrorResponse(501, server_config, &files);
+	}
+
+	reply(client, response);
+}
+
+/**
+ * @brief CGI/1.1 meta-variables, shared by fork/execve CGI and FastCGI params.
+ */
+std::vector<std::string> HttpResponse::buildCgiEnv(const HttpRequest &req, const std::string &script_path)
+{
+	std::vector<std::string> env_vars;
+	std::string uri = req.getPath();
+	std::string query_string = "";
+	size_t q_pos = uri.find('?');
+	if (q_pos != std::string::npos)
+	{
+		query_string = uri.substr(q_pos + 1);
+		uri = uri.substr(0, q_pos);
+	}
+	env_vars.push_back("REQUEST_METHOD=" + req.getMethod());
+	env_vars.push_back("QUERY_STRING=" + query_string);
+	env_vars.push_back("SCRIPT_FILENAME=" + script_path);
+	env_vars.push_back("SCRIPT_NAME=" + uri);
+	env_vars.push_back("PATH_INFO=" + uri);
+	env_vars.push_back("REQUEST_URI=" + req.getPath());
+	env_vars.push_back("SERVER_PROTOCOL=HTTP/1.1");
+	if (req.getBodySize() > 0)
+		env_vars.push_back("CONTENT_LENGTH=" + toString(req.getBodySize()));
+	env_vars.push_back("CONTENT_TYPE=" + req.getHeader(HEADER_CONTENT_TYPE));
+	env_vars.push_back("REDIRECT_STATUS=200");
+	return env_vars;
+}
+
+void HttpResponse::handleCgiRequest(Client &client, const LocationConfig &loc_config, const std::string &script_path)
+{
+	(void)loc_config;
+	const HttpRequest &req = client.request;
+
+	// Setup Env
+	std::vector<std::string> env_vars = buildCgiEnv(req, script_path);
+	std::vector<char *> envp;
+	for (size_t i = 0; i < env_vars.size(); ++i)
+		envp.push_back(const_cast<char *>(env_vars[i].c_str()));
+	envp.push_back(NULL);
+
+	if (req.isBodyInFile())
+		lseek(req.getBodyFd(), 0, SEEK_SET);
+
+	int pipe_in[2], pipe_out[2];
+	if (pipe(pipe_in) == -1 || pipe(pipe_out) == -1)
+	{
+		reply(client, buildErrorResponse(500, NULL));
+		return;
+	}
+
+	pid_t pid = fork();
+	if (pid == -1)
+	{
+		close(pipe_in[0]);
+		close(pipe_in[1]);
+		close(pipe_out[0]);
+		close(pipe_out[1]);
+		reply(client, buildErrorResponse(500, NULL));
+		return;
+	}
+
+	if (pid == 0)
+	{ // Child
+		close(pipe_in[1]);
+		close(pipe_out[0]);
+		// A spooled body is read by the script straight from its temp file
+		if (req.isBodyInFile())
+			dup2(req.getBodyFd(), STDIN_FILENO);
+		else
+			dup2(pipe_in[0], STDIN_FILENO);
+		dup2(pipe_out[1], STDOUT_FILENO);
+		close(pipe_in[0]);
+		close(pipe_out[1]);
+
+		char *argv[] = {const_cast<char *>(script_path.c_str()), NULL};
+
+		execve(script_path.c_str(), argv, envp.data());
+
+		// If we reach here, execve failed!
+		perror("execve failed"); // <--- Prints the exact error (e.g. Permission denied, No such file)
+		std::cerr << "Failed to execute: " << script_path << std::endl;
+
+		exit(1);
+	}
+	else
+	{ // Parent
+		close(pipe_in[0]);
+		close(pipe_out[1]);
+
+		// An in-memory body is fed by the event loop as the script reads it
+		client.cgi_input.clear();
+		client.cgi_input_pos = 0;
+		client.cgi_pipe_in = -1;
+		if (!req.isBodyInFile() && !req.getBody().empty() && fcntl(pipe_in[1], F_SETFL, O_NONBLOCK) == 0)
+		{
+			fcntl(pipe_in[1], F_SETFD, FD_CLOEXEC);
+			client.cgi_input = req.getBody();
+			client.cgi_pipe_in = pipe_in[1];
+		}
+		else
+			close(pipe_in[1]);
+
+		// Set Client State for Async polling
+		client.is_cgi_active = true;
+		client.cgi_pid = pid;
+		client.cgi_pipe_out = pipe_out[0]; // Read end
+		client.cgi_output_buffer.clear();
+	}
+}
+
+/**
+ * @brief Hand the request to the FastCGI pool; the Webserver picks a connection.
+ *
+ * A spooled body is dup()ed because the request is reset before the backend
+ * has read all of it.
+ */
+void HttpResponse::handleFastCgiRequest(Client &client, const LocationConfig &loc_config, const std::string &script_path)
+{
+	const HttpRequest &req = client.request;
+	FastCgiBody &body = client.fastcgi_body;
+	body = FastCgiBody();
+	if (req.isBodyInFile())
+	{
+		body.fd = dup(req.getBodyFd());
+		if (body.fd < 0)
+		{
+			reply(client, buildErrorResponse(500, NULL));
+			return;
+		}
+		fcntl(body.fd, F_SETFD, FD_CLOEXEC);
+	}
+	else
+		body.data = req.getBody();
+	body.size = req.getBodySize();
+
+	client.fastcgi_pass = loc_config.fastcgi_pass;
+	client.fastcgi_params = buildCgiEnv(req, script_path);
+	client.is_cgi_active = true;
+	client.cgi_output_buffer.clear();
+}
+
+/**
+ * @brief Queue the status line and headers once the CGI header block is complete.
+ *
+ * 'Status:' sets the status line and 'Location:' alone means 302. The body
+ * keeps the script's Content-Length if it sent one, otherwise it is chunked.
+ * Bytes after the block are queued as the first part of the body.
+ * @return false while the header block is still incomplete.
+ */
+bool HttpResponse::beginCgiResponse(Response &res, std::string &cgi_output)
+{
+	// 1. End of the header block, scripts may use bare LF line endings
+	size_t header_end = cgi_output.find("\r\n\r\n");
+	size_t separator = 4;
+	size_t lf_end = cgi_output.find("\n\n");
+	if (lf_end != std::string::npos && lf_end < header_end)
+		header_end = lf_end, separator = 2;
+	if (header_end == std::string::npos)
+		return false;
+
+	// 2. Translate the CGI header fields into an HTTP header
+	std::string status;
+	std::string headers;
+	bool has_length = false;
+	bool has_location = false;
+	std::istringstream lines(cgi_output.substr(0, header_end));
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		size_t colon = line.find(':');
+		if (colon == std::string::npos)
+			continue;
+		std::string name = line.substr(0, colon);
+		size_t value_start = line.find_first_not_of(" \t", colon + 1);
+		size_t value_end = line.find_last_not_of(" \t\r");
+		std::string value;
+		if (value_start != std::string::npos && value_end >= value_start)
+			value = line.substr(value_start, value_end - value_start + 1);
+
+		if (strcasecmp(name.c_str(), "Status") == 0)
+			status = value;
+		// Framing belongs to the server
+		else if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0 || strcasecmp(name.c_str(), "Connection") == 0)
+			continue;
+		else
+		{
+			if (strcasecmp(name.c_str(), "Content-Length") == 0)
+				has_length = true;
+			else if (strcasecmp(name.c_str(), "Location") == 0)
+				has_location = true;
+			headers += name + ": " + value + "\r\n";
+		}
+	}
+	if (status.empty())
+		status = has_location ? "302 Found" : "200 OK";
+
+	// HTTP/1.0 clients know no chunked framing: the close ends the body
+	res.chunked = !has_length && !res.http10;
+	if (!has_length && res.http10)
+		res.close_after = true;
+	std::string head = "HTTP/1.1 " + status + "\r\n" + headers;
+	if (res.chunked)
+		head += "Transfer-Encoding: chunked\r\n";
+	head += "\r\n";
+	res.out.append(head);
+
+	// 3. Whatever followed the header block is already body
+	cgi_output.erase(0, header_end + separator);
+	appendCgiBody(res, cgi_output.data(), cgi_output.size());
+	std::string().swap(cgi_output);
+	return true;
+}
+
+/**
+ * @brief Queue body bytes read from the script, as one chunk when chunked.
+ */
+void HttpResponse::appendCgiBody(Response &res, const char *data, size_t len)
+{
+	if (len == 0)
+		return;
+	std::string part;
+	if (res.chunked)
+	{
+		char size_line[32];
+		int n = std::sprintf(size_line, "%lx\r\n", (unsigned long)len);
+		part.reserve(n + len + 2);
+		part.append(size_line, n);
+		part.append(data, len);
+		part.append("\r\n");
+	}
+	else
+		part.assign(data, len);
+	res.out.adopt(part);
+}
+
+void HttpResponse::endCgiResponse(Response &res)
+{
+	if (res.chunked)
+		res.out.append("0\r\n\r\n");
+}
+
+/**
+ * @brief Output without a header block is sent as plain text; the buffer is moved, not copied.
+ */
+void HttpResponse::buildCgiResponse(Response &res, std::string &cgi_output)
+{
+	res.out.append(buildResponseHeader(200, "OK", cgi_output.length(), "text/plain"));
+	res.out.adopt(cgi_output);
+}
+
+std::string HttpResponse::buildErrorResponse(int status_code, const ServerConfig *server_config, OpenFileCache *files)
+{
+	// Custom Error Page Check
+	if (server_config && server_config->error_pages.count(status_code))
+	{
+		std::string err_path = server_config->error_pages.at(status_code);
+		if (err_path[0] != '/')
+			err_path = server_config->root + "/" + err_path;
+
+		std::string content;
+		if (files)
+		{
+			// Error pages are hot under a scan: read them from the cached descriptor
+			const OpenFile &page = files->lookup(err_path);
+			if (page.fd < 0 || !readFd(page.fd, page.st.st_size, content))
+				content.clear();
+		}
+		else
+			content = getFileContent(err_path);
+		if (!content.empty())
+		{
+			return buildResponseHeader(status_code, "Error", content.length(), "text/html") + content;
+		}
+	}
+
+	// Default Fallback
+	std::string body = "<html><body><h1>Error " + toString(status_code) + "</h1></body></html>";
+	return buildResponseHeader(status_code, "Error", body.length(), "text/html") + body;
+}
+
+std::string HttpResponse::handleGetRequest(Client &client, const LocationConfig &loc_config, const OpenFile &file,
+										   const std::string &uri, StaticCache &cache, const std::string &cache_key)
+{
+	if (file.err != 0)
+		return buildErrorResponse(file.err == EACCES ? 403 : 404, NULL);
+	const std::string &filepath = file.path;
+	const struct stat &file_stat = file.st;
+
+	// Representation headers shared by 200, 206 and 304
+	std::string mime = getMimeType(filepath);
+	bool vary = loc_config.gzip_static || (loc_config.gzip && Compression::isCompressible(mime));
+	std::string headers;
+	if (S_ISREG(file_stat.st_mode))
+	{
+		std::string etag = entityTag(file_stat, false);
+		headers = cacheHeaders(file_stat, etag, loc_config);
+		// Plain copy of a file that has compressed variants: caches must key on the coding
+		if (vary)
+			headers += "Vary: Accept-Encoding\r\n";
+		// Revalidation is answered from the cached metadata alone
+		if (notModified(client.request, etag, file_stat.st_mtime))
+			return buildNotModified(headers);
+	}
+
+	// Range requests are answered from file offsets, never from the cache
+	const std::string &range_header = client.request.getHeader(HEADER_RANGE);
+	if (S_ISREG(file_stat.st_mode) && !range_header.empty() && ifRangeMatches(client.request, file_stat))
+	{
+		std::vector<ByteRange> ranges;
+		int parsed = parseRangeHeader(range_header, file_stat.st_size, ranges);
+		if (parsed < 0)
+			return buildResponseHeader(416, "Range Not Satisfiable", 0, "text/plain",
+									   "Content-Range: bytes */" + toString(file_stat.st_size) + "\r\n");
+		if (parsed > 0)
+		{
+			// The response outlives the cache entry: it sends from its own descriptor
+			int fd = fcntl(file.fd, F_DUPFD_CLOEXEC, 0);
+			if (fd < 0)
+				return buildErrorResponse(500, NULL);
+			return buildRangeResponse(client, fd, file_stat, mime, ranges, headers);
+		}
+	}
+	std::string extra_headers = "Accept-Ranges: bytes\r\n" + headers;
+
+	if (S_ISREG(file_stat.st_mode) && cache.accepts(file_stat.st_size))
+	{
+		// Small file: serialize once and share the buffer with the next requests
+		std::string response = buildResponseHeader(200, "OK", file_stat.st_size, mime, extra_headers);
+		if (!readFd(file.fd, file_stat.st_size, response))
+			return buildErrorResponse(500, NULL);
+		SharedBuffer shared(response);
+		cache.insert(cache_key, filepath, file_stat, shared);
+		client.responses.back().out.appendShared(shared);
+		return "";
+	}
+	if (S_ISREG(file_stat.st_mode) && file_stat.st_size <= INLINE_BODY_MAX)
+	{
+		// Small file: header and body leave in the same write
+		std::string response = buildResponseHeader(200, "OK", file_stat.st_size, mime, extra_headers);
+		if (!readFd(file.fd, file_stat.st_size, response))
+			return buildErrorResponse(500, NULL);
+		return response;
+	}
+	if (S_ISREG(file_stat.st_mode))
+	{
+		// Only the header is built here; the body is streamed with sendfile()
+		if (file_stat.st_size > 0)
+		{
+			int fd = fcntl(file.fd, F_DUPFD_CLOEXEC, 0);
+			if (fd < 0)
+				return buildErrorResponse(500, NULL);
+			client.responses.back().file_fd = fd;
+			client.responses.back().out.appendFile(fd, 0, file_stat.st_size);
+		}
+		return buildResponseHeader(200, "OK", file_stat.st_size, mime, extra_headers);
+	}
+	if (S_ISDIR(file_stat.st_mode))
+	{
+		if (loc_config.autoindex)
+		{
+			std::string listing = generateDirectoryListing(filepath, uri);
+			return buildResponseHeader(200, "OK", listing.length(), "text/html") + listing;
+		}
+		return buildErrorResponse(403, NULL);
+	}
+	return buildErrorResponse(403, NULL);
+}
+
+/**
+ * @brief Answer with a fresh .br/.gz sidecar, or a gzip copy compressed on the fly.
+ *
+ * Compressed copies are kept in 'gzip_cache' under the path of the original,
+ * so they are revalidated against it like any cached response.
+ * @return false to fall back to the identity response.
+ */
+bool HttpResponse::handleCompressedGet(Client &client, const LocationConfig &loc_config, const OpenFile &file,
+									   unsigned codings, StaticCache &gzip_cache, OpenFileCache &files)
+{
+	static const off_t min_length = 256; // Smaller bodies barely shrink
+	if (file.err != 0 || !S_ISREG(file.st.st_mode))
+		return false;
+	// Copies: the sidecar lookups below may replace the entry
+	const std::string filepath = file.path;
+	const struct stat file_stat = file.st;
+	std::string mime = getMimeType(filepath);
+
+	// 1. Precompressed sidecars, ignored once older than the file
+	if (loc_config.gzip_static)
+	{
+		static const struct
+		{
+			unsigned coding;
+			const char *suffix;
+			const char *name;
+		} sidecars[] = {{CODING_BR, ".br", "br"}, {CODING_GZIP, ".gz", "gzip"}};
+		for (size_t i = 0; i < 2; ++i)
+		{
+			if (!(codings & sidecars[i].coding))
+				continue;
+			const OpenFile &sidecar = files.lookup(filepath + sidecars[i].suffix);
+			if (sidecar.fd < 0 || sidecar.st.st_mtime < file_stat.st_mtime)
+				continue;
+			const struct stat &sidecar_stat = sidecar.st;
+			// The sidecar is stored bytes: it has its own strong validators
+			std::string etag = entityTag(sidecar_stat, false);
+			std::string headers = cacheHeaders(sidecar_stat, etag, loc_config) + "Vary: Accept-Encoding\r\n";
+			if (notModified(client.request, etag, sidecar_stat.st_mtime))
+			{
+				reply(client, buildNotModified(headers));
+				return true;
+			}
+			Response &res = client.responses.back();
+			if (sidecar_stat.st_size > 0)
+			{
+				int fd = fcntl(sidecar.fd, F_DUPFD_CLOEXEC, 0);
+				if (fd < 0)
+					return false;
+				res.file_fd = fd;
+				res.out.appendFile(fd, 0, sidecar_stat.st_size);
+			}
+			reply(client, buildResponseHeader(200, "OK", sidecar_stat.st_size, mime,
+											  std::string("Content-Encoding: ") + sidecars[i].name + "\r\n" + headers));
+			return true;
+		}
+	}
+
+	// 2. On the fly gzip, only for text small enough for the gzip cache
+	if (!loc_config.gzip || !(codings & CODING_GZIP) || !Compression::isCompressible(mime) ||
+		file_stat.st_size < min_length || !gzip_cache.accepts(file_stat.st_size))
+		return false;
+	// An empty entry records that the file did not shrink: serve it as is
+	const CachedResponse *cached = gzip_cache.lookup(filepath);
+	if (cached && cached->response.size() == 0)
+		return false;
+	// Output of our zlib, not stored bytes: weak validator of the original
+	std::string etag = entityTag(file_stat, true);
+	std::string headers = cacheHeaders(file_stat, etag, loc_config) + "Vary: Accept-Encoding\r\n";
+	if (notModified(client.request, etag, file_stat.st_mtime))
+	{
+		reply(client, buildNotModified(headers));
+		return true;
+	}
+	if (cached)
+	{
+		reply(client, cached->response);
+		return true;
+	}
+	const OpenFile &source = files.lookup(filepath);
+	if (source.fd < 0 || source.st.st_size != file_stat.st_size)
+		return false;
+	std::string body;
+	bool complete = readFd(source.fd, file_stat.st_size, body);
+	std::string compressed;
+	if (!complete)
+		return false;
+	if (!Compression::gzip(body.data(), body.size(), compressed))
+	{
+		// Not smaller (or no zlib): remember it instead of compressing again next time
+		gzip_cache.insert(filepath, filepath, file_stat, SharedBuffer());
+		return false;
+	}
+	SharedBuffer shared(buildResponseHeader(200, "OK", compressed.size(), mime, "Content-Encoding: gzip\r\n" + headers) +
+						compressed);
+	gzip_cache.insert(filepath, filepath, file_stat, shared);
+	reply(client, shared);
+	return true;
+}
+
+/**
+ * @brief Parse a "bytes=" Range header against a file of the given size.
+ *
+ * @return 1 if 'ranges' holds at least one satisfiable range, 0 if the header
+ * must be ignored (syntax error, other unit, too many ranges) and -1 if no
+ * range is satisfiable (416).
+ */
+int HttpResponse::parseRangeHeader(const std::string &header, off_t size, std::vector<ByteRange> &ranges)
+{
+	static const size_t max_ranges = 16;
+
+	if (header.compare(0, 6, "bytes=") != 0)
+		return 0;
+
+	std::stringstream ss(header.substr(6));
+	std::string spec;
+	size_t count = 0;
+	while (std::getline(ss, spec, ','))
+	{
+		size_t first = spec.find_first_not_of(" \t");
+		size_t last = spec.find_last_not_of(" \t");
+		if (first == std::string::npos)
+			continue;
+		spec = spec.substr(first, last - first + 1);
+		if (++count > max_ranges)
+			return 0;
+
+		size_t dash = spec.find('-');
+		if (dash == std::string::npos || spec.find_first_not_of("0123456789-") != std::string::npos)
+			return 0;
+		std::string start_str = spec.substr(0, dash);
+		std::string end_str = spec.substr(dash + 1);
+		if (end_str.find('-') != std::string::npos || (start_str.empty() && end_str.empty()))
+			return 0;
+
+		ByteRange range;
+		if (start_str.empty())
+		{
+			// Suffix range: the last N bytes
+			off_t suffix = std::strtoll(end_str.c_str(), NULL, 10);
+			if (suffix == 0 || size == 0)
+				continue;
+			range.start = suffix >= size ? 0 : size - suffix;
+			range.end = size - 1;
+		}
+		else
+		{
+			range.start = std::strtoll(start_str.c_str(), NULL, 10);
+			range.end = end_str.empty() ? size - 1 : std::strtoll(end_str.c_str(), NULL, 10);
+			if (!end_str.empty() && range.end < range.start)
+				return 0;
+			if (range.start >= size)
+				continue;
+			if (range.end >= size)
+				range.end = size - 1;
+		}
+		ranges.push_back(range);
+	}
+	if (count == 0)
+		return 0;
+	return ranges.empty() ? -1 : 1;
+}
+
+/**
+ * @brief If-Range only lets the Range through when the validator still matches.
+ *
+ * Entity tags compare strongly here: a weak one never matches.
+ */
+bool HttpResponse::ifRangeMatches(const HttpRequest &req, const struct stat &st)
+{
+	std::string if_range = req.getHeader("If-Range");
+	if (if_range.empty())
+		return true;
+	if (if_range[0] == '"')
+		return if_range == entityTag(st, false);
+	return if_range == httpDate(st.st_mtime);
+}
+
+/**
+ * @brief Entity tag from inode, size and mtime; weak for bytes we generate.
+ */
+std::string HttpResponse::entityTag(const struct stat &st, bool weak)
+{
+	std::stringstream ss;
+	ss << (weak ? "W/\"" : "\"") << std::hex << (unsigned long)st.st_ino << "-" << (unsigned long long)st.st_size << "-"
+	   << (unsigned long)st.st_mtime << "\"";
+	return ss.str();
+}
+
+/**
+ * @brief ETag, Last-Modified and the location's Cache-Control.
+ *
+ * No Expires header: cached responses are serialized once, so an absolute
+ * date would go stale while max-age stays right.
+ */
+std::string HttpResponse::cacheHeaders(const struct stat &st, const std::string &etag, const LocationConfig &loc_config)
+{
+	std::string headers = "ETag: " + etag + "\r\nLast-Modified: " + httpDate(st.st_mtime) + "\r\n";
+	if (loc_config.has_expires && loc_config.expires < 0)
+		headers += "Cache-Control: no-cache\r\n";
+	else if (loc_config.has_expires)
+		headers += "Cache-Control: max-age=" + toString(loc_config.expires) + "\r\n";
+	return headers;
+}
+
+bool HttpResponse::isConditional(const HttpRequest &req)
+{
+	return !req.getHeader(HEADER_IF_NONE_MATCH).empty() || !req.getHeader(HEADER_IF_MODIFIED_SINCE).empty();
+}
+
+/**
+ * @brief Whether the client's copy is current (RFC 9110 section 13.2.2 order).
+ *
+ * If-None-Match uses the weak comparison and, when present, overrides
+ * If-Modified-Since.
+ */
+bool HttpResponse::notModified(const HttpRequest &req, const std::string &etag, time_t mtime)
+{
+	const std::string &if_none_match = req.getHeader(HEADER_IF_NONE_MATCH);
+	if (!if_none_match.empty())
+	{
+		std::string opaque = etag.compare(0, 2, "W/") == 0 ? etag.substr(2) : etag;
+		size_t pos = 0;
+		while (pos < if_none_match.size())
+		{
+			size_t end = if_none_match.find(',', pos);
+			if (end == std::string::npos)
+				end = if_none_match.size();
+			size_t first = if_none_match.find_first_not_of(" \t", pos);
+			size_t last = if_none_match.find_last_not_of(" \t", end - 1);
+			pos = end + 1;
+			if (first == std::string::npos || first >= end)
+				continue;
+			std::string tag = if_none_match.substr(first, last - first + 1);
+			if (tag == "*")
+				return true;
+			if (tag.compare(0, 2, "W/") == 0)
+				tag.erase(0, 2);
+			if (tag == opaque)
+				return true;
+		}
+		return false;
+	}
+
+	time_t since;
+	return parseHttpDate(req.getHeader(HEADER_IF_MODIFIED_SINCE), since) && mtime <= since;
+}
+
+std::string HttpResponse::buildNotModified(const std::string &headers)
+{
+	return "HTTP/1.1 304 Not Modified\r\n" + headers + "\r\n";
+}
+
+/**
+ * @brief Parse an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT") as UTC.
+ */
+bool HttpResponse::parseHttpDate(const std::string &value, time_t &t)
+{
+	static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+	int day, year, hour, minute, second;
+	char month_name[4];
+	if (std::sscanf(value.c_str(), "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &day, month_name, &year, &hour, &minute,
+					&second) != 6)
+		return false;
+	const char *found = std::strstr(months, month_name);
+	if (!found || (found - months) % 3 != 0 || std::strlen(month_name) != 3)
+		return false;
+	int month = (found - months) / 3 + 1;
+
+	// Days since 1970-01-01 of a proleptic Gregorian date
+	int y = year - (month <= 2);
+	long era = (y >= 0 ? y : y - 399) / 400;
+	long yoe = y - era * 400;
+	long doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	long days = era * 146097 + doe - 719468;
+	t = (time_t)days * 86400 + hour * 3600 + minute * 60 + second;
+	return true;
+}
+
+/**
+ * @brief Queue a 206 response: one range directly, several as multipart/byteranges.
+ */
+std::string HttpResponse::buildRangeResponse(Client &client, int fd, const struct stat &st, const std::string &mime,
+											 const std::vector<ByteRange> &ranges, const std::string &headers)
+{
+	std::string total = toString(st.st_size);
+	Response &res = client.responses.back();
+	res.file_fd = fd;
+
+	if (ranges.size() == 1)
+	{
+		size_t length = ranges[0].end - ranges[0].start + 1;
+		res.out.appendFile(fd, ranges[0].start, length);
+		std::stringstream extra;
+		extra << "Accept-Ranges: bytes\r\nContent-Range: bytes " << ranges[0].start << "-" << ranges[0].end << "/" << total
+			  << "\r\n" << headers;
+		return buildResponseHeader(206, "Partial Content", length, mime, extra.str());
+	}
+
+	static unsigned long boundary_seq = 0;
+	std::stringstream boundary_ss;
+	boundary_ss << "webserv_" << std::hex << (unsigned long)time(NULL) << "_" << ++boundary_seq;
+	std::string boundary = boundary_ss.str();
+
+	size_t content_length = 0;
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		std::stringstream prefix;
+		if (i > 0)
+			prefix << "\r\n";
+		prefix << "--" << boundary << "\r\nContent-Type: " << mime
+			   << "\r\nContent-Range: bytes " << ranges[i].start << "-" << ranges[i].end << "/" << total << "\r\n\r\n";
+		size_t length = ranges[i].end - ranges[i].start + 1;
+		content_length += prefix.str().size() + length;
+		res.out.append(prefix.str());
+		res.out.appendFile(fd, ranges[i].start, length);
+	}
+	std::string closing = "\r\n--" + boundary + "--\r\n";
+	content_length += closing.size();
+	res.out.append(closing);
+
+	return buildResponseHeader(206, "Partial Content", content_length, "multipart/byteranges; boundary=" + boundary,
+							   "Accept-Ranges: bytes\r\n" + headers);
+}
+
+std::string HttpResponse::httpDate(time_t t)
+{
+	char buf[64];
+	strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&t));
+	return buf;
+}
+
+std::string HttpResponse::handlePostRequest(const LocationConfig &loc_config, HttpRequest &req)
+{
+	std::string full_path = loc_config.root + req.getPath();
+	if (!req.saveBody(full_path))
+		return buildErrorResponse(500, NULL);
+	std::string body = "File created";
+	return buildResponseHeader(201, "Created", body.length(), "text/plain") + body;
+}
+
+std::string HttpResponse::handleDeleteRequest(const LocationConfig &loc_config, const std::string &uri)
+{
+	std::string filepath = loc_config.root + uri;
+	if (std::remove(filepath.c_str()) != 0)
+		return buildErrorResponse(500, NULL);
+	return buildResponseHeader(204, "No Content", 0, "");
+}
+
+bool HttpResponse::isCgiRequest(const LocationConfig &loc_config, const std::string &path)
+{
+	if (loc_config.cgi_ext.empty())
+		return !loc_config.fastcgi_pass.empty(); // The whole location is served by FastCGI
+	size_t dot = path.rfind('.');
+	if (dot == std::string::npos)
+		return false;
+	std::string ext = path.substr(dot);
+	for (size_t i = 0; i < loc_config.cgi_ext.size(); ++i)
+		if (loc_config.cgi_ext[i] == ext)
+			return true;
+	return false;
+}
+
+std::string HttpResponse::getFileContent(const std::string &filepath)
+{
+	std::ifstream ifs(filepath.c_str());
+	if (!ifs.is_open())
+		return "";
+	std::stringstream buffer;
+	buffer << ifs.rdbuf();
+	return buffer.str();
+}
+
+/**
+ * @brief Append exactly 'size' bytes read from fd to out.
+ *
+ * pread() from offset 0: cached descriptors are shared, their offset is never used.
+ */
+bool HttpResponse::readFd(int fd, size_t size, std::string &out)
+{
+	size_t start = out.size();
+	out.resize(start + size);
+	size_t done = 0;
+	while (done < size)
+	{
+		ssize_t n = pread(fd, &out[start + done], size - done, done);
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+std::string HttpResponse::getMimeType(const std::string &filepath)
+{
+	static const struct
+	{
+		const char *ext;
+		const char *type;
+	} types[] = {{"html", "text/html"},
+				 {"htm", "text/html"},
+				 {"css", "text/css"},
+				 {"js", "application/javascript"},
+				 {"json", "application/json"},
+				 {"xml", "application/xml"},
+				 {"txt", "text/plain"},
+				 {"svg", "image/svg+xml"},
+				 {"png", "image/png"},
+				 {"jpg", "image/jpeg"},
+				 {"jpeg", "image/jpeg"},
+				 {"gif", "image/gif"},
+				 {"webp", "image/webp"},
+				 {"ico", "image/x-icon"},
+				 {"pdf", "application/pdf"},
+				 {"woff2", "font/woff2"},
+				 {"mp4", "video/mp4"}};
+
+	size_t dot = filepath.rfind('.');
+	if (dot == std::string::npos || filepath.find('/', dot) != std::string::npos)
+		return "text/plain";
+	std::string ext = filepath.substr(dot + 1);
+	for (size_t i = 0; i < ext.size(); ++i)
+		ext[i] = std::tolower((unsigned char)ext[i]);
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
+	{
+		if (ext == types[i].ext)
+			return types[i].type;
+	}
+	return "text/plain";
+}
+
+std::string HttpResponse::generateDirectoryListing(const std::string &dir_path, const std::string &uri)
+{
+	DIR *dir = opendir(dir_path.c_str());
+	if (!dir)
+		return "";
+	std::stringstream ss;
+	ss << "<html><body><h1>Index of " << uri << "</h1><hr><pre>";
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		ss << "<a href=\"" << entry->d_name << "\">" << entry->d_name << "</a><br>";
+	}
+	closedir(dir);
+	ss << "</pre></body></html>";
+	return ss.str();
+}
+
+std::string HttpResponse::buildResponseHeader(int status, const std::string &text, size_t len, const std::string &type,
+											  const std::string &extra_headers)
+{
+	std::stringstream ss;
+	ss << "HTTP/1.1 " << status << " " << text << "\r\nContent-Type: " << type << "\r\nContent-Length: " << len << "\r\n"
+	   << extra_headers << "\r\n";
+	return ss.str();
+}
+
+std::string HttpResponse::buildRedirectResponse(int status, const std::string &loc)
+{
+	std::stringstream ss;
+	ss << "HTTP/1.1 " << status << " Found\r\nLocation: " << loc << "\r\nContent-Length: 0\r\n\r\n";
+	return ss.str();
 }
\ No newline at end of file
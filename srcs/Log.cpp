@@ -0,0 +1,35 @@
+#include "../includes/Log.hpp"
+#include <unistd.h>
+#include <ctime>
+
+static const char *level_names[] = {"error", "warn", "info", "debug"};
+
+LogLevel Log::_level = LEVEL_WARN;
+
+void Log::setLevel(LogLevel level) { _level = level; }
+
+void Log::write(LogLevel level, const std::string &message)
+{
+	// "2024/01/31 12:00:00 [warn] 1234: message"
+	char stamp[32];
+	time_t now = time(NULL);
+	strftime(stamp, sizeof(stamp), "%Y/%m/%d %H:%M:%S", localtime(&now));
+	std::ostringstream line;
+	line << stamp << " [" << level_names[level] << "] " << getpid() << ": " << message << "\n";
+	std::string bytes = line.str();
+	ssize_t ret = ::write(STDERR_FILENO, bytes.data(), bytes.size());
+	(void)ret; // Nowhere left to report a failing stderr
+}
+
+bool Log::parseLevel(const std::string &name, LogLevel &level)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		if (name == level_names[i])
+		{
+			level = static_cast<LogLevel>(i);
+			return true;
+		}
+	}
+	return false;
+}
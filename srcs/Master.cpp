@@ -0,0 +1,119 @@
+#include "../includes/Master.hpp"
+#include "../includes/Webserver.hpp"
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+static volatile sig_atomic_t g_shutdown = 0;
+
+static void onShutdownSignal(int sig)
+{
+	(void)sig;
+	g_shutdown = 1;
+}
+
+Master::Master(const std::vector<ServerConfig> &configs, const GlobalConfig &global, Metrics &metrics,
+			   int worker_processes)
+	: _configs(configs), _global(global), _metrics(metrics), _workers(worker_processes, -1),
+	  _spawn_times(worker_processes, 0) {}
+
+Master::~Master() {}
+
+/**
+ * @brief Fork one worker. The child never returns from this function.
+ */
+pid_t Master::spawnWorker(size_t index)
+{
+	pid_t pid = fork();
+	if (pid != 0)
+		return pid;
+
+	// Worker: default signal dispositions, die together with the master
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+#ifdef __linux__
+	prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+	try
+	{
+		Webserver server;
+		server.init(_configs, _global, _metrics, index, true);
+		server.run();
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << "Worker " << getpid() << ": " << e.what() << std::endl;
+		_exit(1);
+	}
+	_exit(0);
+}
+
+/**
+ * @brief Start all workers and respawn them as they exit until SIGINT/SIGTERM.
+ */
+void Master::run()
+{
+	// No SA_RESTART: the signal has to interrupt waitpid()
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = onShutdownSignal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	for (size_t i = 0; i < _workers.size(); ++i)
+	{
+		_workers[i] = spawnWorker(i);
+		_spawn_times[i] = time(NULL);
+		if (_workers[i] < 0)
+			perror("fork");
+	}
+	std::cout << "Master " << getpid() << " started " << _workers.size() << " workers" << std::endl;
+
+	while (!g_shutdown)
+	{
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("waitpid");
+			break;
+		}
+		for (size_t i = 0; i < _workers.size(); ++i)
+		{
+			if (_workers[i] != pid || g_shutdown)
+				continue;
+			std::cerr << "Worker " << pid << " exited (status " << status << "), respawning" << std::endl;
+			// Avoid a fork loop when workers die right away (e.g. bind failure)
+			if (time(NULL) - _spawn_times[i] < 1)
+				sleep(1);
+			_workers[i] = spawnWorker(i);
+			_spawn_times[i] = time(NULL);
+			if (_workers[i] < 0)
+				perror("fork");
+		}
+	}
+	stopWorkers();
+}
+
+void Master::stopWorkers()
+{
+	for (size_t i = 0; i < _workers.size(); ++i)
+	{
+		if (_workers[i] > 0)
+			kill(_workers[i], SIGTERM);
+	}
+	for (size_t i = 0; i < _workers.size(); ++i)
+	{
+		if (_workers[i] > 0)
+			waitpid(_workers[i], NULL, 0);
+		_workers[i] = -1;
+	}
+	std::cout << "Master stopped" << std::endl;
+}
@@ -0,0 +1,171 @@
+#include "../includes/Metrics.hpp"
+#include "../includes/Router.hpp"
+#include <sys/mman.h>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <vector>
+#include <stdexcept>
+
+Metrics::Metrics()
+	: _base(NULL), _size(0), _workers(0), _locations(0), _slot_size(0), _stats(NULL), _location_stats(NULL) {}
+
+Metrics::~Metrics()
+{
+	if (_base)
+		munmap(_base, _size);
+}
+
+void Metrics::allocate(size_t workers, size_t locations)
+{
+	_workers = workers > 0 ? workers : 1;
+	_locations = locations + 1; // Slot 0: requests that matched no location
+	_slot_size = sizeof(WorkerStats) + _locations * sizeof(LocationStats);
+	_size = _workers * _slot_size;
+	// Shared, so the counters of every worker stay visible to the one answering a scrape
+	void *base = mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		throw std::runtime_error("Error: Cannot map the metrics counters");
+	_base = static_cast<char *>(base); // Zero-filled
+	attach(0);
+}
+
+void Metrics::attach(size_t worker)
+{
+	_stats = reinterpret_cast<WorkerStats *>(_base + worker * _slot_size);
+	_location_stats = reinterpret_cast<LocationStats *>(_base + worker * _slot_size + sizeof(WorkerStats));
+	// Connections and scripts of a crashed predecessor are gone; totals carry on
+	_stats->connections_active = 0;
+	_stats->connections_idle = 0;
+	_stats->cgi_running = 0;
+}
+
+unsigned long long Metrics::nowMs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void Metrics::recordResponse(int route, int status, unsigned long long latency_ms)
+{
+	int status_class = status / 100 - 1;
+	if (status_class < 0 || status_class > 4)
+		return;
+	_stats->responses[status_class]++;
+	if (route >= 0 && (size_t)route + 1 < _locations)
+		_location_stats[route + 1].responses[status_class]++;
+
+	int bucket = 0;
+	while (bucket < LATENCY_BUCKETS && latency_ms > (1ULL << bucket))
+		++bucket;
+	_stats->latency[bucket]++;
+	_stats->latency_sum_ms += latency_ms;
+}
+
+const WorkerStats &Metrics::workerSlot(size_t worker) const
+{
+	return *reinterpret_cast<const WorkerStats *>(_base + worker * _slot_size);
+}
+
+const LocationStats *Metrics::locationSlots(size_t worker) const
+{
+	return reinterpret_cast<const LocationStats *>(_base + worker * _slot_size + sizeof(WorkerStats));
+}
+
+/**
+ * @brief Sum of all worker slots in Prometheus text exposition format 0.0.4.
+ */
+std::string Metrics::render(const Router &router) const
+{
+	static const char *classes[] = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+
+	// 1. Sum the slots
+	WorkerStats total;
+	std::memset(&total, 0, sizeof(total));
+	std::vector<LocationStats> locations(_locations);
+	for (size_t w = 0; w < _workers; ++w)
+	{
+		const WorkerStats &slot = workerSlot(w);
+		total.connections_active += slot.connections_active;
+		total.connections_idle += slot.connections_idle;
+		total.cgi_running += slot.cgi_running;
+		total.connections_accepted += slot.connections_accepted;
+		total.connections_handled += slot.connections_handled;
+		total.connections_reaped += slot.connections_reaped;
+		total.bytes_in += slot.bytes_in;
+		total.bytes_out += slot.bytes_out;
+		total.cgi_timeouts += slot.cgi_timeouts;
+		total.latency_sum_ms += slot.latency_sum_ms;
+		for (int i = 0; i < 5; ++i)
+			total.responses[i] += slot.responses[i];
+		for (int i = 0; i <= LATENCY_BUCKETS; ++i)
+			total.latency[i] += slot.latency[i];
+		const LocationStats *slot_locations = locationSlots(w);
+		for (size_t l = 0; l < _locations; ++l)
+			for (int i = 0; i < 5; ++i)
+				locations[l].responses[i] += slot_locations[l].responses[i];
+	}
+
+	// 2. Connections, traffic and CGI
+	std::ostringstream out;
+	out.precision(15);
+	out << "# TYPE webserv_connections_active gauge\n"
+		<< "webserv_connections_active " << total.connections_active << "\n"
+		<< "# TYPE webserv_connections_idle gauge\n"
+		<< "webserv_connections_idle " << total.connections_idle << "\n"
+		<< "# TYPE webserv_connections_accepted_total counter\n"
+		<< "webserv_connections_accepted_total " << total.connections_accepted << "\n"
+		<< "# TYPE webserv_connections_handled_total counter\n"
+		<< "webserv_connections_handled_total " << total.connections_handled << "\n"
+		<< "# TYPE webserv_connections_reaped_total counter\n"
+		<< "webserv_connections_reaped_total " << total.connections_reaped << "\n"
+		<< "# TYPE webserv_received_bytes_total counter\n"
+		<< "webserv_received_bytes_total " << total.bytes_in << "\n"
+		<< "# TYPE webserv_sent_bytes_total counter\n"
+		<< "webserv_sent_bytes_total " << total.bytes_out << "\n"
+		<< "# TYPE webserv_cgi_running gauge\n"
+		<< "webserv_cgi_running " << total.cgi_running << "\n"
+		<< "# TYPE webserv_cgi_timeouts_total counter\n"
+		<< "webserv_cgi_timeouts_total " << total.cgi_timeouts << "\n";
+
+	// 3. Responses by status class, overall and per location
+	out << "# TYPE webserv_responses_total counter\n";
+	for (int i = 0; i < 5; ++i)
+		out << "webserv_responses_total{class=\"" << classes[i] << "\"} " << total.responses[i] << "\n";
+	out << "# TYPE webserv_location_responses_total counter\n";
+	for (size_t l = 0; l < _locations; ++l)
+	{
+		std::string labels = "server=\"\",location=\"\"";
+		if (l > 0)
+		{
+			if (l - 1 >= router.routeCount())
+				break;
+			const Route &route = router.route(l - 1);
+			std::ostringstream server;
+			server << (route.server->server_names.empty() ? "" : route.server->server_names[0]) << ":"
+				   << route.server->port;
+			labels = "server=\"" + server.str() + "\",location=\"" + route.location->path + "\"";
+		}
+		for (int i = 0; i < 5; ++i)
+		{
+			if (locations[l].responses[i] != 0)
+				out << "webserv_location_responses_total{" << labels << ",class=\"" << classes[i] << "\"} "
+					<< locations[l].responses[i] << "\n";
+		}
+	}
+
+	// 4. Latency histogram, cumulative buckets in seconds
+	out << "# TYPE webserv_request_duration_seconds histogram\n";
+	unsigned long long count = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; ++i)
+	{
+		count += total.latency[i];
+		out << "webserv_request_duration_seconds_bucket{le=\"" << (1ULL << i) / 1000.0 << "\"} " << count << "\n";
+	}
+	count += total.latency[LATENCY_BUCKETS];
+	out << "webserv_request_duration_seconds_bucket{le=\"+Inf\"} " << count << "\n"
+		<< "webserv_request_duration_seconds_sum " << total.latency_sum_ms / 1000.0 << "\n"
+		<< "webserv_request_duration_seconds_count " << count << "\n";
+	return out.str();
+}
@@ -0,0 +1,123 @@
+#include "../includes/OpenFileCache.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+OpenFileCache::OpenFileCache() : _max_entries(0), _valid_seconds(60), _cache_errors(false) {}
+
+OpenFileCache::~OpenFileCache()
+{
+	for (LruList::iterator it = _lru.begin(); it != _lru.end(); ++it)
+		release(*it);
+	release(_uncached);
+}
+
+void OpenFileCache::configure(size_t max_entries, int valid_seconds, bool cache_errors)
+{
+	_max_entries = max_entries;
+	_valid_seconds = valid_seconds;
+	_cache_errors = cache_errors;
+}
+
+bool OpenFileCache::isEnabled() const { return _max_entries > 0; }
+
+/**
+ * @brief open() + fstat(): one path walk gives both the fd and the metadata.
+ */
+void OpenFileCache::resolve(OpenFile &file)
+{
+	release(file);
+	file.err = 0;
+	file.checked_at = time(NULL);
+	// O_NONBLOCK: a FIFO under the root must not hang the worker
+	int fd = open(file.path.c_str(), O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+	{
+		file.err = errno;
+		return;
+	}
+	if (fstat(fd, &file.st) != 0)
+	{
+		file.err = errno;
+		close(fd);
+		return;
+	}
+	if (!S_ISREG(file.st.st_mode))
+	{
+		close(fd);
+		return;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC); // Keep it out of CGI children
+	file.fd = fd;
+}
+
+void OpenFileCache::release(OpenFile &file)
+{
+	if (file.fd != -1)
+		close(file.fd);
+	file.fd = -1;
+}
+
+const OpenFile &OpenFileCache::lookup(const std::string &path)
+{
+	if (!isEnabled())
+	{
+		_uncached.path = path;
+		resolve(_uncached);
+		return _uncached;
+	}
+
+	// 1. Hit: revalidate once per interval, reopen only if the file changed
+	time_t now = time(NULL);
+	std::map<std::string, LruList::iterator>::iterator found = _index.find(path);
+	if (found != _index.end())
+	{
+		OpenFile &file = *found->second;
+		if (now - file.checked_at >= _valid_seconds)
+		{
+			struct stat st;
+			if (file.err == 0 && stat(path.c_str(), &st) == 0 && st.st_ino == file.st.st_ino &&
+				st.st_dev == file.st.st_dev && st.st_size == file.st.st_size && st.st_mtime == file.st.st_mtime)
+				file.checked_at = now;
+			else
+				resolve(file);
+		}
+		if (file.err == 0 || _cache_errors)
+		{
+			_lru.splice(_lru.begin(), _lru, found->second);
+			return file;
+		}
+		// Now failing and errors are not cached
+		erase(found->second);
+	}
+
+	// 2. Miss: resolve, and keep the result unless it is an uncached error
+	OpenFile file;
+	file.path = path;
+	resolve(file);
+	if (file.err != 0 && !_cache_errors)
+	{
+		release(_uncached);
+		_uncached = file;
+		return _uncached;
+	}
+	while (_lru.size() >= _max_entries && !_lru.empty())
+		erase(--_lru.end());
+	_lru.push_front(file);
+	_index[path] = _lru.begin();
+	return _lru.front();
+}
+
+void OpenFileCache::forget(const std::string &path)
+{
+	std::map<std::string, LruList::iterator>::iterator found = _index.find(path);
+	if (found != _index.end())
+		erase(found->second);
+}
+
+void OpenFileCache::erase(LruList::iterator it)
+{
+	release(*it);
+	_index.erase(it->path);
+	_lru.erase(it);
+}
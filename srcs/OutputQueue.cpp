@@ -0,0 +1,292 @@
+#include "../includes/OutputQueue.hpp"
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+/* ************************************************************************** */
+/*                                SharedBuffer                                */
+/* ************************************************************************** */
+
+SharedBuffer::SharedBuffer() : _block(NULL) {}
+
+SharedBuffer::SharedBuffer(const std::string &bytes) : _block(new Block)
+{
+	_block->bytes = bytes;
+	_block->refs = 1;
+}
+
+SharedBuffer::SharedBuffer(const SharedBuffer &other) : _block(other._block)
+{
+	if (_block)
+		++_block->refs;
+}
+
+SharedBuffer &SharedBuffer::operator=(const SharedBuffer &other)
+{
+	if (_block != other._block)
+	{
+		release();
+		_block = other._block;
+		if (_block)
+			++_block->refs;
+	}
+	return *this;
+}
+
+SharedBuffer::~SharedBuffer() { release(); }
+
+void SharedBuffer::release()
+{
+	if (_block && --_block->refs == 0)
+		delete _block;
+	_block = NULL;
+}
+
+const char *SharedBuffer::data() const { return _block ? _block->bytes.data() : ""; }
+size_t SharedBuffer::size() const { return _block ? _block->bytes.size() : 0; }
+
+/* ************************************************************************** */
+/*                                OutputQueue                                 */
+/* ************************************************************************** */
+
+// Bytes of a memory segment; a shared one may start past its buffer's head
+static const char *segmentData(const OutputSegment &segment)
+{
+	if (segment.kind == OutputSegment::SEG_SHARED)
+		return segment.shared.data() + segment.offset;
+	return segment.owned.data();
+}
+
+static size_t segmentSize(const OutputSegment &segment)
+{
+	if (segment.kind == OutputSegment::SEG_SHARED)
+		return segment.shared.size() - segment.offset;
+	return segment.owned.size();
+}
+
+OutputQueue::OutputQueue() : _cursor(0), _bytes(0), _sent(0) {}
+
+void OutputQueue::append(const std::string &bytes)
+{
+	if (bytes.empty())
+		return;
+	_segments.push_back(OutputSegment());
+	_segments.back().owned = bytes;
+	_bytes += bytes.size();
+}
+
+void OutputQueue::adopt(std::string &bytes)
+{
+	if (bytes.empty())
+		return;
+	_bytes += bytes.size();
+	_segments.push_back(OutputSegment());
+	_segments.back().owned.swap(bytes);
+}
+
+void OutputQueue::appendShared(const SharedBuffer &buffer)
+{
+	if (buffer.size() == 0)
+		return;
+	_segments.push_back(OutputSegment());
+	_segments.back().kind = OutputSegment::SEG_SHARED;
+	_segments.back().shared = buffer;
+	_bytes += buffer.size();
+}
+
+void OutputQueue::appendFile(int fd, off_t offset, size_t length)
+{
+	if (length == 0)
+		return;
+	_segments.push_back(OutputSegment());
+	OutputSegment &segment = _segments.back();
+	segment.kind = OutputSegment::SEG_FILE;
+	segment.fd = fd;
+	segment.offset = offset;
+	segment.length = length;
+}
+
+void OutputQueue::prepend(const std::string &bytes)
+{
+	if (bytes.empty())
+		return;
+	_segments.push_front(OutputSegment());
+	_segments.front().owned = bytes;
+	_bytes += bytes.size();
+}
+
+/**
+ * @brief Add header lines once the response head is built, e.g. from the cache.
+ *
+ * A shared head is not copied: its status line moves to a new segment with
+ * 'bytes', and the shared segment then starts after it.
+ */
+void OutputQueue::insertAfterStatusLine(const std::string &bytes)
+{
+	if (bytes.empty() || _segments.empty() || _cursor != 0 || _segments.front().kind == OutputSegment::SEG_FILE)
+		return;
+	OutputSegment &front = _segments.front();
+	const char *base = segmentData(front);
+	const void *lf = std::memchr(base, '\n', segmentSize(front));
+	if (!lf)
+		return;
+	size_t line = static_cast<const char *>(lf) - base + 1;
+	_bytes += bytes.size();
+	if (front.kind == OutputSegment::SEG_OWNED)
+	{
+		front.owned.insert(line, bytes);
+		return;
+	}
+	std::string head(base, line);
+	head += bytes;
+	front.offset += line;
+	_segments.push_front(OutputSegment());
+	_segments.front().owned.swap(head);
+}
+
+bool OutputQueue::empty() const { return _segments.empty(); }
+size_t OutputQueue::bufferedBytes() const { return _bytes; }
+unsigned long long OutputQueue::sentBytes() const { return _sent; }
+
+size_t OutputQueue::peek(char *buf, size_t len) const
+{
+	if (_segments.empty() || _segments.front().kind == OutputSegment::SEG_FILE)
+		return 0;
+	const OutputSegment &segment = _segments.front();
+	const char *base = segmentData(segment);
+	size_t size = segmentSize(segment);
+	if (len > size - _cursor)
+		len = size - _cursor;
+	std::memcpy(buf, base + _cursor, len);
+	return len;
+}
+
+void OutputQueue::clear()
+{
+	_segments.clear();
+	_cursor = 0;
+	_bytes = 0;
+}
+
+/**
+ * @brief Send as much as the socket accepts, in segment order.
+ */
+OutputQueue::FlushStatus OutputQueue::flush(int sock_fd)
+{
+	while (!_segments.empty())
+	{
+		FlushStatus status;
+		if (_segments.front().kind == OutputSegment::SEG_FILE)
+		{
+			status = flushFile(sock_fd, _segments.front());
+			if (status == FLUSH_DONE)
+				_segments.pop_front();
+		}
+		else
+			status = flushMemory(sock_fd);
+		if (status != FLUSH_DONE)
+			return status;
+	}
+	return FLUSH_DONE;
+}
+
+// A failed call worth retrying on the next write event, not a dead socket
+static OutputQueue::FlushStatus failure()
+{
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		return OutputQueue::FLUSH_AGAIN;
+	return OutputQueue::FLUSH_ERROR;
+}
+
+/**
+ * @brief Gather the leading memory segments into one writev() call.
+ * @return FLUSH_DONE if all of them were sent.
+ */
+OutputQueue::FlushStatus OutputQueue::flushMemory(int sock_fd)
+{
+	static const size_t max_iov = 64;
+	struct iovec iov[max_iov];
+	size_t count = 0;
+
+	for (size_t i = 0; i < _segments.size() && count < max_iov; ++i)
+	{
+		const OutputSegment &segment = _segments[i];
+		if (segment.kind == OutputSegment::SEG_FILE)
+			break;
+		const char *base = segmentData(segment);
+		size_t len = segmentSize(segment);
+		size_t skip = (i == 0) ? _cursor : 0;
+		iov[count].iov_base = const_cast<char *>(base + skip);
+		iov[count].iov_len = len - skip;
+		++count;
+	}
+
+	ssize_t sent = writev(sock_fd, iov, count);
+	if (sent < 0)
+		return failure();
+	if (sent == 0)
+		return FLUSH_AGAIN;
+	_bytes -= sent;
+	_sent += sent;
+
+	// Drop what went out; a partial segment only moves the cursor
+	size_t left = sent;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (left < iov[i].iov_len)
+		{
+			_cursor += left;
+			return FLUSH_AGAIN;
+		}
+		left -= iov[i].iov_len;
+		_segments.pop_front();
+		_cursor = 0;
+	}
+	return FLUSH_DONE;
+}
+
+/**
+ * @brief Push the next part of a file segment straight from the page cache.
+ * @return FLUSH_DONE once the whole segment was sent.
+ */
+OutputQueue::FlushStatus OutputQueue::flushFile(int sock_fd, OutputSegment &segment)
+{
+	// Cap a single call so one large download cannot starve other clients
+	size_t len = segment.length;
+	if (len > 1024 * 1024)
+		len = 1024 * 1024;
+
+#ifdef __linux__
+	ssize_t sent = sendfile(sock_fd, segment.fd, &segment.offset, len);
+	if (sent < 0)
+		return failure();
+	if (sent == 0)
+		return FLUSH_SHORT;
+	segment.length -= sent;
+	_sent += sent;
+#else
+	char buffer[65536];
+	if (len > sizeof(buffer))
+		len = sizeof(buffer);
+	ssize_t bytes_read = pread(segment.fd, buffer, len, segment.offset);
+	if (bytes_read < 0)
+		return errno == EINTR ? FLUSH_AGAIN : FLUSH_ERROR;
+	if (bytes_read == 0)
+		return FLUSH_SHORT;
+	ssize_t sent = send(sock_fd, buffer, bytes_read, 0);
+	if (sent < 0)
+		return failure();
+	if (sent == 0)
+		return FLUSH_AGAIN;
+	segment.offset += sent;
+	segment.length -= sent;
+	_sent += sent;
+#endif
+	// Stop after one capped chunk, the event loop comes back for the rest
+	return segment.length == 0 ? FLUSH_DONE : FLUSH_AGAIN;
+}
@@ -0,0 +1,225 @@
+#include "../includes/Router.hpp"
+#include <cctype>
+
+Router::Router() : _first(NULL) {}
+
+unsigned Router::methodBit(const std::string &method)
+{
+	if (method == "GET")
+		return METHOD_GET;
+	if (method == "POST")
+		return METHOD_POST;
+	if (method == "DELETE")
+		return METHOD_DELETE;
+	return 0;
+}
+
+size_t Router::routeCount() const { return _routes.size(); }
+const Route &Router::route(size_t id) const { return _routes[id]; }
+
+// FNV-1a of the lowercased name, seeded with the port
+size_t Router::hashName(int port, const char *name, size_t len)
+{
+	size_t hash = 2166136261u ^ (size_t)port;
+	for (size_t i = 0; i < len; ++i)
+	{
+		hash ^= (unsigned char)std::tolower((unsigned char)name[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/**
+ * @brief Compile the virtual host table and one location trie per server block.
+ */
+void Router::build(const std::vector<ServerConfig> &configs)
+{
+	_first = configs.empty() ? NULL : &configs[0];
+	_buckets.clear();
+	_defaults.clear();
+	_roots.clear();
+	_nodes.clear();
+	_routes.clear();
+
+	// 1. Virtual hosts: about two buckets per name keeps the chains short
+	size_t names = 0;
+	for (size_t i = 0; i < configs.size(); ++i)
+		names += configs[i].server_names.size();
+	size_t bucket_count = 1;
+	while (bucket_count < names * 2)
+		bucket_count <<= 1;
+	_buckets.resize(bucket_count);
+
+	for (size_t i = 0; i < configs.size(); ++i)
+	{
+		const ServerConfig &server = configs[i];
+		bool has_default = false;
+		for (size_t j = 0; j < _defaults.size() && !has_default; ++j)
+			has_default = (_defaults[j].first == server.port);
+		if (!has_default)
+			_defaults.push_back(std::make_pair(server.port, &server));
+
+		for (size_t j = 0; j < server.server_names.size(); ++j)
+		{
+			VirtualHost vhost;
+			vhost.port = server.port;
+			vhost.server = &server;
+			for (size_t k = 0; k < server.server_names[j].size(); ++k)
+				vhost.name += (char)std::tolower((unsigned char)server.server_names[j][k]);
+			// A name repeated on the same port keeps its first block
+			std::vector<VirtualHost> &bucket = _buckets[hashName(vhost.port, vhost.name.data(), vhost.name.size()) &
+														(bucket_count - 1)];
+			bool taken = false;
+			for (size_t k = 0; k < bucket.size() && !taken; ++k)
+				taken = (bucket[k].port == vhost.port && bucket[k].name == vhost.name);
+			if (!taken)
+				bucket.push_back(vhost);
+		}
+
+		// 2. Location trie of this block
+		_roots.push_back(_nodes.size());
+		_nodes.push_back(TrieNode());
+		for (size_t j = 0; j < server.locations.size(); ++j)
+			addLocation(_roots.back(), server, server.locations[j]);
+	}
+}
+
+/**
+ * @brief Insert a location under its path segments ("/a/b/" is a -> b).
+ */
+void Router::addLocation(int root, const ServerConfig &server, const LocationConfig &location)
+{
+	int node = root;
+	const std::string &path = location.path;
+	size_t pos = 0;
+	while (pos < path.size())
+	{
+		if (path[pos] == '/')
+		{
+			++pos;
+			continue;
+		}
+		size_t end = path.find('/', pos);
+		if (end == std::string::npos)
+			end = path.size();
+		int child = findChild(node, path.data() + pos, end - pos);
+		if (child == -1)
+		{
+			child = _nodes.size();
+			_nodes.push_back(TrieNode());
+			std::vector<std::pair<std::string, int> > &children = _nodes[node].children;
+			std::pair<std::string, int> entry(path.substr(pos, end - pos), child);
+			size_t at = 0;
+			while (at < children.size() && children[at].first < entry.first)
+				++at;
+			children.insert(children.begin() + at, entry);
+		}
+		node = child;
+		pos = end;
+	}
+
+	// The first of duplicate locations wins, as with the former linear scan
+	if (_nodes[node].route != -1)
+		return;
+	Route route;
+	route.location = &location;
+	route.server = &server;
+	route.id = _routes.size();
+	if (location.methods.empty())
+		route.methods = METHOD_GET;
+	for (size_t i = 0; i < location.methods.size(); ++i)
+		route.methods |= methodBit(location.methods[i]);
+	_nodes[node].route = _routes.size();
+	_routes.push_back(route);
+}
+
+// Binary search of the sorted children, without building a string
+int Router::findChild(int node, const char *segment, size_t len) const
+{
+	const std::vector<std::pair<std::string, int> > &children = _nodes[node].children;
+	size_t low = 0;
+	size_t high = children.size();
+	while (low < high)
+	{
+		size_t mid = (low + high) / 2;
+		int cmp = children[mid].first.compare(0, std::string::npos, segment, len);
+		if (cmp == 0)
+			return children[mid].second;
+		if (cmp < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return -1;
+}
+
+const ServerConfig *Router::findServer(int port, const std::string &host) const
+{
+	// 1. Host without its port ("[::1]:8080", "example.com:8080") or trailing dot
+	size_t len = host.size();
+	size_t colon = host.rfind(':');
+	if (colon != std::string::npos && host.find(']', colon) == std::string::npos)
+		len = colon;
+	if (len > 0 && host[len - 1] == '.')
+		--len;
+
+	// 2. Exact server_name on this port
+	if (len > 0 && !_buckets.empty())
+	{
+		const std::vector<VirtualHost> &bucket = _buckets[hashName(port, host.data(), len) & (_buckets.size() - 1)];
+		for (size_t i = 0; i < bucket.size(); ++i)
+		{
+			const VirtualHost &vhost = bucket[i];
+			if (vhost.port != port || vhost.name.size() != len)
+				continue;
+			size_t k = 0;
+			while (k < len && vhost.name[k] == std::tolower((unsigned char)host[k]))
+				++k;
+			if (k == len)
+				return vhost.server;
+		}
+	}
+
+	// 3. Default block of the port
+	for (size_t i = 0; i < _defaults.size(); ++i)
+	{
+		if (_defaults[i].first == port)
+			return _defaults[i].second;
+	}
+	return _first;
+}
+
+/**
+ * @brief Longest location prefix of 'path' made of whole segments; the query is ignored.
+ */
+Route Router::findLocation(const ServerConfig &server, const std::string &path) const
+{
+	size_t index = &server - _first;
+	if (!_first || index >= _roots.size())
+		return Route();
+
+	int node = _roots[index];
+	int best = _nodes[node].route;
+	size_t stop = path.find('?');
+	if (stop == std::string::npos)
+		stop = path.size();
+	size_t pos = 0;
+	while (pos < stop)
+	{
+		if (path[pos] == '/')
+		{
+			++pos;
+			continue;
+		}
+		size_t end = path.find('/', pos);
+		if (end == std::string::npos || end > stop)
+			end = stop;
+		node = findChild(node, path.data() + pos, end - pos);
+		if (node == -1)
+			break;
+		if (_nodes[node].route != -1)
+			best = _nodes[node].route;
+		pos = end;
+	}
+	return best == -1 ? Route() : _routes[best];
+}
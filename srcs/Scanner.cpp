@@ -0,0 +1,249 @@
+#include "../includes/Scanner.hpp"
+#include <cstring>
+
+#if !defined(WEBSERV_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+/* ************************************************************************** */
+/*                                 Portable                                   */
+/* ************************************************************************** */
+
+// tchar: "!#$%&'*+-.^_`|~", digits and letters; filled at startup
+static bool tchar[256];
+
+static void buildTokenTable()
+{
+	for (int i = '0'; i <= '9'; ++i)
+		tchar[i] = true;
+	for (int i = 'A'; i <= 'Z'; ++i)
+		tchar[i] = tchar[i + 'a' - 'A'] = true;
+	for (const char *p = "!#$%&'*+-.^_`|~"; *p; ++p)
+		tchar[(unsigned char)*p] = true;
+}
+
+static size_t findBlankPortable(const char *data, size_t len)
+{
+	size_t i = 0;
+	while (i < len && data[i] != ' ' && data[i] != '\t')
+		++i;
+	return i;
+}
+
+static size_t tokenLengthPortable(const char *data, size_t len)
+{
+	size_t i = 0;
+	while (i < len && tchar[(unsigned char)data[i]])
+		++i;
+	return i;
+}
+
+#ifdef SCANNER_X86
+
+/* ************************************************************************** */
+/*                                   SSE2                                     */
+/* ************************************************************************** */
+
+// Bytes in [lo, hi]: (c - lo) saturating-minus (hi - lo) is 0 only inside
+static inline __m128i inRange16(__m128i v, char lo, char hi)
+{
+	__m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+	return _mm_cmpeq_epi8(_mm_subs_epu8(shifted, _mm_set1_epi8(hi - lo)), _mm_setzero_si128());
+}
+
+// 0xff for every tchar byte, as six ranges and three single characters
+static inline __m128i tokenMask16(__m128i v)
+{
+	__m128i mask = _mm_or_si128(inRange16(v, '0', '9'), inRange16(v, 'A', 'Z'));
+	mask = _mm_or_si128(mask, inRange16(v, '^', 'z')); // ^ _ ` a-z
+	mask = _mm_or_si128(mask, inRange16(v, '#', '\'')); // # $ % & '
+	mask = _mm_or_si128(mask, inRange16(v, '*', '+'));
+	mask = _mm_or_si128(mask, inRange16(v, '-', '.'));
+	mask = _mm_or_si128(mask, _mm_cmpeq_epi8(v, _mm_set1_epi8('!')));
+	mask = _mm_or_si128(mask, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+	return _mm_or_si128(mask, _mm_cmpeq_epi8(v, _mm_set1_epi8('~')));
+}
+
+static size_t findBlankSse2(const char *data, size_t len)
+{
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		int hits = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)));
+		if (hits)
+			return i + __builtin_ctz(hits);
+	}
+	return i + findBlankPortable(data + i, len - i);
+}
+
+static size_t tokenLengthSse2(const char *data, size_t len)
+{
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		int invalid = ~_mm_movemask_epi8(tokenMask16(v)) & 0xffff;
+		if (invalid)
+			return i + __builtin_ctz(invalid);
+	}
+	return i + tokenLengthPortable(data + i, len - i);
+}
+
+/* ************************************************************************** */
+/*                                   AVX2                                     */
+/* ************************************************************************** */
+
+#define AVX2 __attribute__((target("avx2")))
+
+// For each low nibble, a bit per high nibble 0-7 whose byte is a tchar
+#define TCHAR_BITMAP                                                                                          \
+	(char)0xe8, (char)0xfc, (char)0xf8, (char)0xfc, (char)0xfc, (char)0xfc, (char)0xfc, (char)0xfc, (char)0xf8, \
+		(char)0xf8, (char)0xf4, (char)0x54, (char)0xd0, (char)0x54, (char)0xf4, (char)0x70
+#define HIGH_NIBBLE_BIT 1, 2, 4, 8, 16, 32, 64, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0
+
+// 0xff for every byte that is not a tchar: two table lookups instead of nine compares
+AVX2 static inline __m256i invalidMask32(__m256i v)
+{
+	const __m256i bitmap = _mm256_setr_epi8(TCHAR_BITMAP, TCHAR_BITMAP);
+	const __m256i bit = _mm256_setr_epi8(HIGH_NIBBLE_BIT, HIGH_NIBBLE_BIT);
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	__m256i low = _mm256_and_si256(v, nibble);
+	__m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+	__m256i hit = _mm256_and_si256(_mm256_shuffle_epi8(bitmap, low), _mm256_shuffle_epi8(bit, high));
+	return _mm256_cmpeq_epi8(hit, _mm256_setzero_si256());
+}
+
+AVX2 static inline __m128i invalidMask16(__m128i v)
+{
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	__m128i low = _mm_and_si128(v, nibble);
+	__m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+	__m128i hit = _mm_and_si128(_mm_shuffle_epi8(_mm_setr_epi8(TCHAR_BITMAP), low),
+								_mm_shuffle_epi8(_mm_setr_epi8(HIGH_NIBBLE_BIT), high));
+	return _mm_cmpeq_epi8(hit, _mm_setzero_si128());
+}
+
+// Tails stay in VEX-encoded 16-byte steps: legacy SSE code after dirty
+// upper halves stalls, so the scalar remainder clears them first
+AVX2 static size_t findBlankAvx2(const char *data, size_t len)
+{
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+		unsigned hits = _mm256_movemask_epi8(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+		if (hits)
+			return i + __builtin_ctz(hits);
+	}
+	if (i + 16 <= len)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		int hits = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+		if (hits)
+			return i + __builtin_ctz(hits);
+		i += 16;
+	}
+	_mm256_zeroupper(); // GCC misses the exit through the scalar call
+	return i + findBlankPortable(data + i, len - i);
+}
+
+AVX2 static size_t tokenLengthAvx2(const char *data, size_t len)
+{
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+		unsigned invalid = _mm256_movemask_epi8(invalidMask32(v));
+		if (invalid)
+			return i + __builtin_ctz(invalid);
+	}
+	if (i + 16 <= len)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		int invalid = _mm_movemask_epi8(invalidMask16(v));
+		if (invalid)
+			return i + __builtin_ctz(invalid);
+		i += 16;
+	}
+	_mm256_zeroupper(); // GCC misses the exit through the scalar call
+	return i + tokenLengthPortable(data + i, len - i);
+}
+
+#undef HIGH_NIBBLE_BIT
+#undef TCHAR_BITMAP
+#undef AVX2
+
+#endif // SCANNER_X86
+
+/* ************************************************************************** */
+/*                                 Dispatch                                   */
+/* ************************************************************************** */
+
+struct ScannerImpl
+{
+	const char *name;
+	size_t (*findBlank)(const char *, size_t);
+	size_t (*tokenLength)(const char *, size_t);
+	bool (*supported)();
+};
+
+static bool always() { return true; }
+
+#ifdef SCANNER_X86
+static bool hasAvx2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+#endif
+
+// Widest first
+static const ScannerImpl impls[] = {
+#ifdef SCANNER_X86
+	{"avx2", findBlankAvx2, tokenLengthAvx2, hasAvx2},
+	{"sse2", findBlankSse2, tokenLengthSse2, always},
+#endif
+	{"portable", findBlankPortable, tokenLengthPortable, always}};
+
+static const ScannerImpl *selectImpl()
+{
+	size_t i = 0;
+	while (!impls[i].supported())
+		++i;
+	buildTokenTable();
+	return &impls[i];
+}
+
+static const ScannerImpl *impl = selectImpl();
+
+// glibc's memchr already runs an SSE2/AVX2/EVEX loop picked for the CPU and
+// unrolled further than a loop here would be, so every variant shares it
+size_t Scanner::findLineFeed(const char *data, size_t len)
+{
+	const void *nl = std::memchr(data, '\n', len);
+	return nl ? static_cast<const char *>(nl) - data : len;
+}
+
+size_t Scanner::findBlank(const char *data, size_t len) { return impl->findBlank(data, len); }
+
+size_t Scanner::tokenLength(const char *data, size_t len) { return impl->tokenLength(data, len); }
+
+const char *Scanner::implementation() { return impl->name; }
+
+bool Scanner::useImplementation(const char *name)
+{
+	for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i)
+	{
+		if (std::strcmp(impls[i].name, name) == 0 && impls[i].supported())
+		{
+			impl = &impls[i];
+			return true;
+		}
+	}
+	return false;
+}
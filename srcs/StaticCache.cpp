@@ -0,0 +1,113 @@
+#include "../includes/StaticCache.hpp"
+#include <sys/stat.h>
+
+// Budget charged for an entry: its response plus what indexes it, so empty
+// "not worth compressing" entries are bounded too
+static unsigned long entryCost(const std::string &key, const std::string &file_path, const SharedBuffer &response)
+{
+	return response.size() + 2 * key.size() + 2 * file_path.size() + sizeof(CachedResponse);
+}
+
+StaticCache::StaticCache() : _bytes(0), _max_bytes(0), _max_file(0), _valid_seconds(1) {}
+
+void StaticCache::configure(unsigned long max_bytes, unsigned long max_file, int valid_seconds)
+{
+	_max_bytes = max_bytes;
+	_max_file = max_file;
+	_valid_seconds = valid_seconds;
+}
+
+bool StaticCache::isEnabled() const { return _max_bytes > 0; }
+
+/**
+ * @brief Whether a file of this size is small enough to be cached.
+ */
+bool StaticCache::accepts(off_t file_size) const
+{
+	return isEnabled() && (unsigned long)file_size <= _max_file;
+}
+
+/**
+ * @brief Find a cached response and move it to the front of the LRU list.
+ */
+const CachedResponse *StaticCache::lookup(const std::string &key)
+{
+	std::map<std::string, LruList::iterator>::iterator found = _index.find(key);
+	if (found == _index.end())
+		return NULL;
+
+	LruList::iterator it = found->second;
+	time_t now = time(NULL);
+	if (now - it->checked_at >= _valid_seconds)
+	{
+		struct stat st;
+		if (stat(it->file_path.c_str(), &st) != 0 || st.st_size != it->size || st.st_mtime != it->mtime)
+		{
+			erase(it);
+			return NULL;
+		}
+		it->checked_at = now;
+	}
+	_lru.splice(_lru.begin(), _lru, it);
+	return &*it;
+}
+
+/**
+ * @brief Store a serialized response, evicting least recently used entries to fit.
+ */
+void StaticCache::insert(const std::string &key, const std::string &file_path,
+						 const struct stat &st, const SharedBuffer &response)
+{
+	unsigned long cost = entryCost(key, file_path, response);
+	if (!isEnabled() || cost > _max_bytes)
+		return;
+
+	std::map<std::string, LruList::iterator>::iterator found = _index.find(key);
+	if (found != _index.end())
+		erase(found->second);
+	while (_bytes + cost > _max_bytes && !_lru.empty())
+		erase(--_lru.end());
+
+	CachedResponse entry;
+	entry.key = key;
+	entry.file_path = file_path;
+	entry.response = response;
+	entry.size = st.st_size;
+	entry.mtime = st.st_mtime;
+	entry.checked_at = time(NULL);
+	_lru.push_front(entry);
+	_index[key] = _lru.begin();
+	_keys_by_file.insert(std::make_pair(file_path, key));
+	_bytes += cost;
+}
+
+/**
+ * @brief Drop the entry cached under 'path' and any that served it as a directory index.
+ */
+void StaticCache::forget(const std::string &path)
+{
+	std::map<std::string, LruList::iterator>::iterator found = _index.find(path);
+	if (found != _index.end())
+		erase(found->second);
+	// Index files are cached under their directory
+	std::multimap<std::string, std::string>::iterator by_file;
+	while ((by_file = _keys_by_file.find(path)) != _keys_by_file.end())
+		erase(_index[by_file->second]);
+}
+
+void StaticCache::erase(LruList::iterator it)
+{
+	typedef std::multimap<std::string, std::string>::iterator FileIterator;
+	std::pair<FileIterator, FileIterator> range = _keys_by_file.equal_range(it->file_path);
+	for (FileIterator by_file = range.first; by_file != range.second; ++by_file)
+	{
+		if (by_file->second == it->key)
+		{
+			_keys_by_file.erase(by_file);
+			break;
+		}
+	}
+	_bytes -= entryCost(it->key, it->file_path, it->response);
+	_index.erase(it->key);
+	_lru.erase(it);
+}
@@ -0,0 +1,151 @@
+#include "../includes/TimerWheel.hpp"
+#include <time.h>
+
+TimerWheel::TimerWheel() : _now(0), _start_ms(monotonicMs()), _count(0)
+{
+	for (int i = 0; i < LEVELS * SLOTS; ++i)
+		_heads[i] = -1;
+}
+
+unsigned long long TimerWheel::monotonicMs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Schedule fd to fire in timeout_ms, never early and at most one tick late.
+ */
+void TimerWheel::arm(int fd, unsigned long timeout_ms)
+{
+	if (fd < 0)
+		return;
+	if ((size_t)fd >= _nodes.size())
+		_nodes.resize(fd + 1);
+	unlink(fd);
+
+	// First tick boundary at or after the deadline; _now may lag the clock
+	unsigned long long deadline = monotonicMs() - _start_ms + timeout_ms;
+	unsigned long long expires = (deadline + TICK_MS - 1) / TICK_MS;
+	_nodes[fd].expires = expires > _now ? expires : _now + 1;
+	place(fd);
+	++_count;
+}
+
+void TimerWheel::cancel(int fd)
+{
+	if (fd < 0 || (size_t)fd >= _nodes.size() || _nodes[fd].slot == -1)
+		return;
+	unlink(fd);
+}
+
+bool TimerWheel::isArmed(int fd) const
+{
+	return fd >= 0 && (size_t)fd < _nodes.size() && _nodes[fd].slot != -1;
+}
+
+/**
+ * @brief Put an armed node into the slot matching its distance from now.
+ */
+void TimerWheel::place(int fd)
+{
+	Node &node = _nodes[fd];
+	unsigned long long delta = node.expires - _now;
+	int level = 0;
+	while (level < LEVELS - 1 && delta >= (1ULL << (SLOT_BITS * (level + 1))))
+		++level;
+	if (level == LEVELS - 1 && delta >= (1ULL << (SLOT_BITS * LEVELS)))
+		node.expires = _now + (1ULL << (SLOT_BITS * LEVELS)) - 1; // Beyond the wheel: clamp
+
+	int slot = level * SLOTS + (int)((node.expires >> (SLOT_BITS * level)) & (SLOTS - 1));
+	node.slot = slot;
+	node.prev = -1;
+	node.next = _heads[slot];
+	if (node.next != -1)
+		_nodes[node.next].prev = fd;
+	_heads[slot] = fd;
+}
+
+void TimerWheel::unlink(int fd)
+{
+	Node &node = _nodes[fd];
+	if (node.slot == -1)
+		return;
+	if (node.prev != -1)
+		_nodes[node.prev].next = node.next;
+	else
+		_heads[node.slot] = node.next;
+	if (node.next != -1)
+		_nodes[node.next].prev = node.prev;
+	node.slot = node.prev = node.next = -1;
+	--_count;
+}
+
+/**
+ * @brief Move the timers of the current slot of 'level' one level closer.
+ */
+void TimerWheel::cascade(int level)
+{
+	int slot = level * SLOTS + (int)((_now >> (SLOT_BITS * level)) & (SLOTS - 1));
+	int fd = _heads[slot];
+	_heads[slot] = -1;
+	while (fd != -1)
+	{
+		int next = _nodes[fd].next;
+		place(fd);
+		fd = next;
+	}
+}
+
+int TimerWheel::nextTimeout() const
+{
+	if (_count == 0)
+		return -1;
+
+	// Nearest armed slot of the first level, else the next cascade
+	unsigned long long ticks = SLOTS - (_now & (SLOTS - 1));
+	for (unsigned long long i = 1; i < ticks; ++i)
+	{
+		if (_heads[(_now + i) & (SLOTS - 1)] != -1)
+		{
+			ticks = i;
+			break;
+		}
+	}
+	unsigned long long due = _start_ms + (_now + ticks) * TICK_MS;
+	unsigned long long now = monotonicMs();
+	return due > now ? (int)(due - now) : 0;
+}
+
+void TimerWheel::expire(std::vector<int> &expired)
+{
+	expired.clear();
+	unsigned long long target = (monotonicMs() - _start_ms) / TICK_MS;
+	if (_count == 0)
+		_now = target; // Nothing to cascade or fire: skip the idle ticks
+	while (_now < target)
+	{
+		++_now;
+		// On a wrap of a level, its parent's next slot falls into range
+		for (int level = 1; level < LEVELS; ++level)
+		{
+			if ((_now & ((1ULL << (SLOT_BITS * level)) - 1)) != 0)
+				break;
+			cascade(level);
+		}
+
+		int slot = (int)(_now & (SLOTS - 1));
+		int fd = _heads[slot];
+		_heads[slot] = -1;
+		while (fd != -1)
+		{
+			Node &node = _nodes[fd];
+			int next = node.next;
+			node.slot = node.prev = node.next = -1;
+			--_count;
+			expired.push_back(fd);
+			fd = next;
+		}
+	}
+}
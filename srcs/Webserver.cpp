@@ -2,14 +2,93 @@
 #include "../includes/Config.hpp"
 #include "../includes/HttpResponse.hpp"
 #include <algorithm> // For std::find
+#include <csignal>
+#include <cerrno>
+#include <netinet/tcp.h>
 
-Webserver::Webserver() {}
-Webserver::~Webserver() {}
+// Set by SIGINT/SIGTERM: leave the loop so destructors flush the access logs
+static volatile sig_atomic_t g_stop = 0;
 
-void Webserver::init(const std::vector<ServerConfig> &configs)
+static void onStopSignal(int sig)
+{
+	(void)sig;
+	g_stop = 1;
+}
+
+// CGI output queued for a slow client before the pipe stops being read
+static const size_t CGI_OUTPUT_HIGH_WATER = 256 * 1024;
+
+// Pending connections the kernel queues while the listeners are paused
+static const int LISTEN_BACKLOG = 511;
+// Idle keep-alive connections closed per pass when out of room
+static const size_t REAP_BATCH = 16;
+// Retry accept() after running out of descriptors, if no connection closes first
+static const unsigned long ACCEPT_RETRY_MS = 1000;
+
+// Status code of a response whose status line has not been sent yet, 0 if unknown
+static int statusCode(const OutputQueue &out)
+{
+	char line[12];
+	if (out.peek(line, sizeof(line)) < sizeof(line) || std::memcmp(line, "HTTP/1.", 7) != 0)
+		return 0;
+	return std::atoi(line + 9);
+}
+
+// The front response has bytes to send, or is complete and only needs popping
+static bool canSend(const Response &res)
+{
+	return res.ready && (!res.out.empty() || !res.streaming);
+}
+
+Webserver::Webserver()
+	: _loop(NULL), _reuse_port(false), _pipeline_depth(16), _fastcgi_max_conns(8), _worker_connections(1024),
+	  _accept_paused(false), _accept_resume_below(0), _metrics(NULL), _now_ms(0) {}
+
+Webserver::~Webserver()
+{
+	for (size_t i = 0; i < _access_logs.size(); ++i)
+		delete _access_logs[i]; // Flushes what is still buffered
+	for (size_t fd = 0; fd < _fd_table.size(); ++fd)
+	{
+		if (_fd_table[fd].type != FD_NONE)
+			close(fd);
+	}
+	delete _loop;
+}
+
+void Webserver::init(const std::vector<ServerConfig> &configs, const GlobalConfig &global, Metrics &metrics,
+					 size_t worker, bool reuse_port)
 {
 	std::vector<int> listening_ports;
-	_configs_ptr = &configs;
+	_router.build(configs);
+	_metrics = &metrics;
+	_metrics->attach(worker);
+	_now_ms = Metrics::nowMs();
+	_reuse_port = reuse_port;
+	_pipeline_depth = global.pipeline_depth;
+	_fastcgi_max_conns = global.fastcgi_connections;
+	_worker_connections = global.worker_connections;
+	_static_cache.configure(global.static_cache_size, global.static_cache_max_file, global.static_cache_valid);
+	_gzip_cache.configure(global.gzip_cache_size, global.static_cache_max_file, global.static_cache_valid);
+	_open_files.configure(global.open_file_cache, global.open_file_cache_valid, global.open_file_cache_errors);
+	for (size_t i = 0; i < configs.size(); ++i)
+	{
+		if (configs[i].access_log.empty())
+			continue;
+		AccessLog *log = NULL;
+		for (size_t j = 0; j < _access_logs.size() && !log; ++j)
+			if (_access_logs[j]->path() == configs[i].access_log)
+				log = _access_logs[j];
+		if (!log)
+		{
+			log = new AccessLog(configs[i].access_log, global.log_format, configs[i].access_log_buffer,
+								configs[i].access_log_flush * 1000UL);
+			_access_logs.push_back(log);
+		}
+		_server_logs[&configs[i]] = log;
+	}
+	_loop = EventLoop::create();
+	std::cout << "Using " << _loop->name() << " event backend" << std::endl;
 
 	for (size_t i = 0; i < configs.size(); ++i)
 	{
@@ -48,6 +127,14 @@ void Webserver::initSocket(int port)
 		perror("setsockopt");
 		exit(EXIT_FAILURE);
 	}
+#ifdef SO_REUSEPORT
+	// Every worker binds its own socket; the kernel balances accepts across them
+	if (_reuse_port && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)))
+	{
+		perror("setsockopt SO_REUSEPORT");
+		exit(EXIT_FAILURE);
+	}
+#endif
 
 	if (fcntl(server_fd, F_SETFL, O_NONBLOCK) < 0)
 	{
@@ -66,275 +153,937 @@ void Webserver::initSocket(int port)
 		perror("bind failed");
 		exit(EXIT_FAILURE);
 	}
-	if (listen(server_fd, 10) < 0)
+	if (listen(server_fd, LISTEN_BACKLOG) < 0)
 	{
 		perror("listen");
 		close(server_fd);
 		exit(EXIT_FAILURE);
 	}
 
-	struct pollfd pfd;
-	pfd.fd = server_fd;
-	pfd.events = POLLIN;
-	pfd.revents = 0;
-	_fds.push_back(pfd);
-	_server_fds.push_back(server_fd);
-	_server_fd_to_port[server_fd] = port;
+	registerFd(server_fd, FD_LISTENER, port, EVENT_READ);
+	_listeners.push_back(server_fd);
 }
 
-void Webserver::run()
+void Webserver::registerFd(int fd, FdType type, int owner, int events)
 {
-	std::cout << "Waiting for connections..." << std::endl;
+	if ((size_t)fd >= _fd_table.size())
+		_fd_table.resize(fd + 1);
+	_fd_table[fd].type = type;
+	_fd_table[fd].owner = owner;
+	_loop->add(fd, events);
+}
+
+void Webserver::unregisterFd(int fd)
+{
+	if (fd < 0 || (size_t)fd >= _fd_table.size() || _fd_table[fd].type == FD_NONE)
+		return;
+	_timers.cancel(fd);
+	_loop->remove(fd);
+	_fd_table[fd] = FdEntry();
+}
 
-	while (true)
+/**
+ * @brief Only ask for write readiness while a response is ready, so idle
+ * keep-alive connections never wake the loop up. Reading pauses while the
+ * pipeline is full or a CGI holds it, which pushes back on the client.
+ */
+void Webserver::updateClientEvents(int client_fd)
+{
+	Client &client = _clients[client_fd];
+	int events = 0;
+	if (!client.closing && !client.is_cgi_active && client.responses.size() < _pipeline_depth)
+		events |= EVENT_READ;
+	if (!client.responses.empty() && canSend(client.responses.front()))
+		events |= EVENT_WRITE;
+	_loop->modify(client_fd, events);
+	updateClientTimer(client, false);
+}
+
+/**
+ * @brief Arm the client timer for what the connection is waiting on.
+ *
+ * Header and keep-alive timers run from the start of their phase, so a
+ * trickling client cannot extend them; body and send timers restart
+ * whenever 'progress' reports that bytes moved.
+ */
+void Webserver::updateClientTimer(Client &client, bool progress)
+{
+	TimerPhase phase;
+	int seconds = 0;
+	if (!client.responses.empty() && canSend(client.responses.front()))
+		phase = TIMER_SEND, seconds = client.server->send_timeout;
+	else if (!client.responses.empty())
+		phase = TIMER_NONE;
+	else if (client.request.isReadingBody())
+		phase = TIMER_BODY, seconds = client.server->client_body_timeout;
+	else if (client.request.hasStarted())
+		phase = TIMER_HEADER, seconds = client.server->client_header_timeout;
+	else
+		phase = TIMER_KEEPALIVE, seconds = client.server->keepalive_timeout;
+
+	if (phase == client.timer_phase && !(progress && (phase == TIMER_BODY || phase == TIMER_SEND)))
+		return;
+	// Idle connections are exactly those waiting in the keep-alive phase
+	if (client.timer_phase == TIMER_KEEPALIVE)
+		_metrics->stats().connections_idle--;
+	if (phase == TIMER_KEEPALIVE)
+		_metrics->stats().connections_idle++;
+	client.timer_phase = phase;
+	if (phase == TIMER_NONE)
+		_timers.cancel(client.fd);
+	else
+		_timers.arm(client.fd, seconds * 1000UL);
+}
+
+/**
+ * @brief Answer every complete request buffered on the connection, in order.
+ *
+ * Stops while a CGI is running (its response holds the queue position),
+ * when the pipeline depth is reached or after a response that closes the
+ * connection; it is resumed once the blocking condition clears.
+ */
+void Webserver::processPipeline(int client_fd)
+{
+	Client &client = _clients[client_fd];
+	while (!client.closing && !client.is_cgi_active && client.responses.size() < _pipeline_depth)
 	{
-		int ret = poll(&_fds[0], _fds.size(), -1);
-		if (ret < 0)
+		if (client.request.needsBodyLimits())
 		{
-			perror("poll");
+			// Headers are in: size the body sink for this server block
+			const ServerConfig *server = _router.findServer(client.listening_port, client.request.getHeader(HEADER_HOST));
+			if (server)
+				client.request.setBodyLimits(server->client_max_body_size, server->client_body_buffer_size,
+											 server->client_body_temp_path);
+			else
+				client.request.setBodyLimits(0, 0, "/tmp");
+			client.request.parse("", 0);
+		}
+		if (!client.request.isFinished())
 			break;
+
+		LOG_DEBUG("Request parsed on client " << client_fd);
+
+		// Pass Client Ref to Logic
+		const ServerConfig *server = _router.findServer(client.listening_port, client.request.getHeader(HEADER_HOST));
+		client.responses.push_back(Response());
+		client.responses.back().started_ms = _now_ms;
+		std::map<const ServerConfig *, AccessLog *>::iterator log = _server_logs.find(server);
+		if (log != _server_logs.end())
+		{
+			// The request is reset before its response is sent: keep what the line needs
+			AccessEntry &entry = client.responses.back().access;
+			client.responses.back().access_log = log->second;
+			entry.remote_addr = client.remote_addr;
+			entry.method = client.request.getMethod();
+			entry.uri = client.request.getPath();
+			entry.version = client.request.getVersion();
+			entry.host = client.request.getHeader(HEADER_HOST);
 		}
-		time_t now = time(NULL);
-		for (std::map<int, Client>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+		// The client's Connection header, then the matched server's keepalive_requests,
+		// decide the connection's fate
+		Response &res = client.responses.back();
+		res.http10 = client.request.getVersion() == "HTTP/1.0";
+		client.requests++;
+		int keepalive_requests = (server ? server : client.server)->keepalive_requests;
+		if (!client.request.keepAlive() || client.requests >= keepalive_requests)
+			res.close_after = true;
+		HttpResponse::processRequest(client, _router, _static_cache, _gzip_cache, _open_files, *_metrics);
+		if (res.close_after)
+			client.closing = true;
+
+		client.cgi_timeout_ms = (server ? server->cgi_timeout : client.server->cgi_timeout) * 1000UL;
+		if (client.is_cgi_active && !client.fastcgi_pass.empty())
 		{
-			if (it->second.is_cgi_active && (now - it->second.cgi_start_time) > 3)
-			{
-				std::cout << "CGI Timeout for Client " << it->first << std::endl;
-
-				// Kill the hanging process
-				kill(it->second.cgi_pid, SIGKILL);
-				waitpid(it->second.cgi_pid, NULL, 0);
-
-				// Clean up pipes from poll
-				int cgi_fd = it->second.cgi_pipe_out;
-				close(cgi_fd);
-				_cgi_fd_to_client_fd.erase(cgi_fd);
-
-				// Remove cgi_fd from _fds vector
-				for (std::vector<struct pollfd>::iterator p_it = _fds.begin(); p_it != _fds.end(); ++p_it)
-				{
-					if (p_it->fd == cgi_fd)
-					{
-						_fds.erase(p_it);
-						break;
-					}
-				}
-
-				// Send 504 Gateway Timeout
-				it->second.is_cgi_active = false;
-				it->second.response_buffer = "HTTP/1.1 504 Gateway Timeout\r\nContent-Length: 0\r\n\r\n";
-				it->second.is_ready_to_write = true;
-			}
+			// FastCGI: queued on a pooled backend connection
+			startFastCgi(client_fd);
 		}
-		// Iterate safely: if we erase an element, we must NOT increment 'i'
-		for (size_t i = 0; i < _fds.size(); /* i incremented manually */)
+		// If logic started a CGI script, watch its pipe while it keeps talking
+		else if (client.is_cgi_active)
 		{
-			bool fd_removed = false;
+			int cgi_fd = client.cgi_pipe_out;
+			client.cgi_paused = false;
+			registerFd(cgi_fd, FD_CGI_OUT, client_fd, EVENT_READ);
+			_timers.arm(cgi_fd, client.cgi_timeout_ms);
+			_metrics->stats().cgi_running++;
+			if (client.cgi_pipe_in != -1)
+				registerFd(client.cgi_pipe_in, FD_CGI_IN, client_fd, EVENT_WRITE);
+			LOG_DEBUG("CGI started, monitoring pipe " << cgi_fd);
+		}
 
-			// READ EVENTS (Include POLLHUP for hang-ups)
-			if (_fds[i].revents & (POLLIN | POLLHUP))
-			{
-				int fd = _fds[i].fd;
-				bool is_server = false;
-				for (size_t j = 0; j < _server_fds.size(); ++j)
-				{
-					if (fd == _server_fds[j])
-					{
-						is_server = true;
-						break;
-					}
-				}
-
-				if (is_server)
-				{
-					acceptConnection(fd);
-				}
-				else if (_cgi_fd_to_client_fd.count(fd))
-				{
-					// handleCgiRead returns false if it closed the FD
-					if (!handleCgiRead(fd))
-						fd_removed = true;
-				}
-				else
-				{
-					// handleClientRead returns false if it closed the FD
-					if (!handleClientRead(fd))
-						fd_removed = true;
-				}
-			}
+		// Keeps pipelined bytes that followed this request
+		client.request.reset();
+		client.request.parse("", 0);
+	}
+	updateClientEvents(client_fd);
+}
 
-			// WRITE EVENTS (Only if FD wasn't just removed)
-			if (!fd_removed && (_fds[i].revents & POLLOUT))
+void Webserver::closeClient(int client_fd)
+{
+	if (_clients.isParked(client_fd))
+	{
+		// Idle keep-alive connection: nothing in flight, no Client to restore
+		_metrics->stats().connections_active--;
+		_metrics->stats().connections_idle--;
+	}
+	else if (_clients.contains(client_fd))
+	{
+		Client &client = _clients[client_fd];
+		if (client.is_cgi_active && !client.fastcgi_pass.empty())
+		{
+			// Client disconnected while its FastCGI request was queued or running
+			if (client.fastcgi_fd != -1)
 			{
-				int fd = _fds[i].fd;
-				if (_clients.count(fd))
-				{
-					handleClientWrite(fd);
-				}
+				_fastcgi[client.fastcgi_fd].abort(client.fastcgi_id);
+				updateFastCgiEvents(client.fastcgi_fd);
 			}
-
-			// Only increment if we didn't remove the current element
-			// (When removed, the next element shifts into current index 'i')
-			if (!fd_removed)
+			else
 			{
-				++i;
+				std::deque<int>::iterator waiting = std::find(_fastcgi_waiting.begin(), _fastcgi_waiting.end(), client_fd);
+				if (waiting != _fastcgi_waiting.end())
+					_fastcgi_waiting.erase(waiting);
 			}
+			if (client.fastcgi_body.fd != -1)
+				close(client.fastcgi_body.fd);
+		}
+		else if (client.is_cgi_active)
+		{
+			// Client disconnected while its CGI was running
+			kill(client.cgi_pid, SIGKILL);
+			waitpid(client.cgi_pid, NULL, 0);
+			_metrics->stats().cgi_running--;
+			unregisterFd(client.cgi_pipe_out);
+			close(client.cgi_pipe_out);
+			client.cgi_pipe_out = -1;
+			closeCgiInput(client);
 		}
+		for (size_t i = 0; i < client.responses.size(); ++i)
+			client.responses[i].closeFile();
+		_metrics->stats().connections_active--;
+		if (client.timer_phase == TIMER_KEEPALIVE)
+			_metrics->stats().connections_idle--;
 	}
+	unregisterFd(client_fd);
+	close(client_fd);
+	_clients.close(client_fd);
 }
 
-bool Webserver::handleClientRead(int client_fd)
+/**
+ * @brief Release the Client of a connection left waiting for its next request.
+ *
+ * Checked once per client event, when no reference to the Client is held.
+ */
+void Webserver::parkIfIdle(int client_fd)
 {
-	char buffer[4096];
-	int bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
+	if (_fd_table[client_fd].type == FD_CLIENT)
+		_clients.park(client_fd);
+}
 
-	if (bytes_read <= 0)
+void Webserver::run()
+{
+	std::cout << "Waiting for connections..." << std::endl;
+
+	// No SA_RESTART: the signal has to interrupt the wait
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = onStopSignal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	std::vector<Event> events;
+	while (!g_stop)
 	{
-		close(client_fd);
-		_clients.erase(client_fd);
+		// Sleep until the nearest timer or log flush at most
+		int ret = _loop->wait(events, nextTimeout());
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+		{
+			perror(_loop->name());
+			break;
+		}
+		_now_ms = Metrics::nowMs();
 
-		// Remove from _fds vector
-		for (std::vector<struct pollfd>::iterator it = _fds.begin(); it != _fds.end(); ++it)
+		for (size_t i = 0; i < events.size(); ++i)
 		{
-			if (it->fd == client_fd)
+			int fd = events[i].fd;
+			int ev = events[i].events;
+			// An earlier event in this batch may have closed the fd
+			if ((size_t)fd >= _fd_table.size())
+				continue;
+
+			switch (_fd_table[fd].type)
 			{
-				_fds.erase(it);
+			case FD_LISTENER:
+				acceptConnection(fd);
+				break;
+			case FD_CGI_OUT:
+				if (ev & (EVENT_READ | EVENT_ERROR))
+					handleCgiRead(fd);
+				break;
+			case FD_CGI_IN:
+				handleCgiWrite(fd);
+				break;
+			case FD_FASTCGI:
+				handleFastCgiEvent(fd, ev);
+				break;
+			case FD_CLIENT:
+				// READ EVENTS (Include hang-ups)
+				if ((ev & (EVENT_READ | EVENT_ERROR)) && !handleClientRead(fd))
+					break;
+				// WRITE EVENTS (Only if FD wasn't just removed)
+				if (ev & EVENT_WRITE)
+					handleClientWrite(fd);
+				parkIfIdle(fd);
+				break;
+			case FD_NONE:
 				break;
 			}
 		}
-		return false; // FD was removed
+		if (_accept_paused)
+			relieveAccept();
+		expireTimers();
+		for (size_t i = 0; i < _access_logs.size(); ++i)
+			_access_logs[i]->flushIfDue(_now_ms);
 	}
-	else
+}
+
+int Webserver::nextTimeout() const
+{
+	int timeout = _timers.nextTimeout();
+	for (size_t i = 0; i < _access_logs.size(); ++i)
 	{
-		buffer[bytes_read] = '\0';
-		bool finished = _clients[client_fd].request.parse(std::string(buffer, bytes_read));
+		long until = _access_logs[i]->untilFlush(_now_ms);
+		if (until >= 0 && (timeout < 0 || until < timeout))
+			timeout = until;
+	}
+	return timeout;
+}
+
+/**
+ * @brief A response was fully sent: count it and queue its access log line.
+ */
+void Webserver::logResponse(Response &res)
+{
+	_metrics->recordResponse(res.route, res.status, _now_ms - res.started_ms);
+	if (!res.access_log)
+		return;
+	res.access.status = res.status;
+	res.access.bytes_sent = res.out.sentBytes();
+	res.access.duration_ms = _now_ms - res.started_ms;
+	res.access_log->log(res.access, _now_ms);
+}
 
-		if (finished)
+/**
+ * @brief Dispatch the timers that fired since the last wakeup.
+ */
+void Webserver::expireTimers()
+{
+	_timers.expire(_expired);
+	for (size_t i = 0; i < _expired.size(); ++i)
+	{
+		int fd = _expired[i];
+		// Closed, or reused and re-armed, by an earlier timeout of this batch
+		if ((size_t)fd >= _fd_table.size() || _timers.isArmed(fd))
+			continue;
+		if (_fd_table[fd].type == FD_CLIENT)
+			handleClientTimeout(fd);
+		else if (_fd_table[fd].type == FD_CGI_OUT)
+			handleCgiTimeout(fd);
+		else if (_fd_table[fd].type == FD_LISTENER)
+			resumeAccept(); // Out of descriptors a while ago: try again
+		else if (_fd_table[fd].type == FD_FASTCGI)
 		{
-			std::cout << "Request Parsed! Processing..." << std::endl;
+			_metrics->stats().cgi_timeouts++;
+			closeFastCgi(fd, "HTTP/1.1 504 Gateway Timeout\r\nContent-Length: 0\r\n\r\n");
+		}
+	}
+}
 
-			// Pass Client Ref to Logic
-			HttpResponse::processRequest(_clients[client_fd], *_configs_ptr);
+void Webserver::handleClientTimeout(int client_fd)
+{
+	if (_clients.isParked(client_fd))
+	{
+		closeClient(client_fd); // Keep-alive timeout of a parked connection
+		return;
+	}
+	Client &client = _clients[client_fd];
+	bool request_started = client.request.hasStarted();
+	if ((client.timer_phase == TIMER_HEADER && request_started) || client.timer_phase == TIMER_BODY)
+	{
+		// A request is half received: say why before closing
+		LOG(LEVEL_INFO, "Request timeout for client " << client_fd);
+		client.responses.push_back(Response());
+		Response &res = client.responses.back();
+		res.started_ms = _now_ms;
+		res.out.append("HTTP/1.1 408 Request Timeout\r\nContent-Length: 0\r\n\r\n");
+		res.ready = true;
+		res.close_after = true;
+		client.closing = true;
+		updateClientEvents(client_fd);
+		return;
+	}
+	// Idle keep-alive, silent new connection or stalled reader
+	closeClient(client_fd);
+}
 
-			// If logic started a CGI script, add its pipe to poll
-			if (_clients[client_fd].is_cgi_active)
-			{
-				int cgi_fd = _clients[client_fd].cgi_pipe_out;
-				struct pollfd pfd;
-				pfd.fd = cgi_fd;
-				pfd.events = POLLIN; // POLLHUP is implicitly handled by poll
-				pfd.revents = 0;
-				_fds.push_back(pfd);
-				_cgi_fd_to_client_fd[cgi_fd] = client_fd;
-				std::cout << "CGI started. Monitoring pipe " << cgi_fd << std::endl;
-			}
+void Webserver::handleCgiTimeout(int cgi_fd)
+{
+	int client_fd = _fd_table[cgi_fd].owner;
+	Client &client = _clients[client_fd];
+	LOG(LEVEL_WARN, "CGI timeout for client " << client_fd);
 
-			_clients[client_fd].request.reset();
-		}
-		return true; // FD kept
-	}
+	// Kill the hanging process
+	kill(client.cgi_pid, SIGKILL);
+	waitpid(client.cgi_pid, NULL, 0);
+	_metrics->stats().cgi_running--;
+	_metrics->stats().cgi_timeouts++;
+
+	// Stop monitoring the pipes
+	unregisterFd(cgi_fd);
+	close(cgi_fd);
+	client.cgi_pipe_out = -1;
+	closeCgiInput(client);
+
+	// 504 Gateway Timeout in place of the CGI response, unless it already started
+	abortCgiOutput(client, "HTTP/1.1 504 Gateway Timeout\r\nContent-Length: 0\r\n\r\n");
 }
 
-bool Webserver::handleCgiRead(int cgi_fd)
+bool Webserver::handleClientRead(int client_fd)
 {
 	char buffer[4096];
-	int bytes_read = read(cgi_fd, buffer, sizeof(buffer) - 1);
+	ssize_t bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
 
-	// Safety check if client disconnected while CGI was running
-	if (_cgi_fd_to_client_fd.find(cgi_fd) == _cgi_fd_to_client_fd.end())
+	// Spurious wakeup, or a stale event for an fd reused within the batch
+	if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return true;
+	if (bytes_read <= 0)
 	{
-		close(cgi_fd);
-		for (std::vector<struct pollfd>::iterator it = _fds.begin(); it != _fds.end(); ++it)
-		{
-			if (it->fd == cgi_fd)
-			{
-				_fds.erase(it);
-				break;
-			}
-		}
-		return false;
+		closeClient(client_fd);
+		return false; // FD was removed
 	}
+	else
+	{
+		buffer[bytes_read] = '\0';
+		_metrics->stats().bytes_in += bytes_read;
+		Client &client = _clients[client_fd];
+		if (client.closing)
+			return true; // Rest of a rejected request: drop it
+		client.request.parse(buffer, bytes_read);
+		processPipeline(client_fd);
+		updateClientTimer(client, true);
+		return true; // FD kept
+	}
+}
+
+bool Webserver::handleCgiRead(int cgi_fd)
+{
+	char buffer[65536];
+	ssize_t bytes_read = read(cgi_fd, buffer, sizeof(buffer));
 
-	int client_fd = _cgi_fd_to_client_fd[cgi_fd];
+	int client_fd = _fd_table[cgi_fd].owner;
+	Client &client = _clients[client_fd];
 
 	if (bytes_read > 0)
 	{
-		buffer[bytes_read] = '\0';
-		_clients[client_fd].cgi_output_buffer += buffer;
+		// cgi_timeout bounds the silence of the script, not its running time
+		if (!client.cgi_paused)
+			_timers.arm(cgi_fd, client.cgi_timeout_ms);
+		streamCgiOutput(client, buffer, bytes_read);
+		updateCgiEvents(client);
 		return true; // FD kept
 	}
 	else
 	{
 		// CGI Finished (EOF or Error)
+		unregisterFd(cgi_fd);
 		close(cgi_fd);
-		for (std::vector<struct pollfd>::iterator it = _fds.begin(); it != _fds.end(); ++it)
+		client.cgi_pipe_out = -1;
+
+		waitpid(client.cgi_pid, NULL, 0); // Reap zombie
+		_metrics->stats().cgi_running--;
+		closeCgiInput(client); // Script exited without reading all of it
+
+		LOG_DEBUG("CGI finished for client " << client_fd);
+		finishCgiOutput(client);
+		return false; // FD removed
+	}
+}
+
+/**
+ * @brief Forward CGI output as soon as the header block is complete.
+ *
+ * Until then the output is collected in cgi_output_buffer; afterwards each
+ * read is queued on the response right away.
+ */
+void Webserver::streamCgiOutput(Client &client, const char *data, size_t len)
+{
+	// The CGI response is the newest one: the pipeline stopped behind it
+	Response &res = client.responses.back();
+	bool was_idle = !canSend(res);
+	if (res.streaming)
+		HttpResponse::appendCgiBody(res, data, len);
+	else
+	{
+		client.cgi_output_buffer.append(data, len);
+		if (!HttpResponse::beginCgiResponse(res, client.cgi_output_buffer))
+			return;
+		res.streaming = true;
+		res.ready = true;
+		if (res.close_after)
+			client.closing = true; // HTTP/1.0 body delimited by the close
+	}
+	// Only the transition to sendable changes the client's events
+	if (was_idle && &res == &client.responses.front())
+		updateClientEvents(client.fd);
+}
+
+/**
+ * @brief The script or backend is done: end the stream, or build the whole
+ * response if its output never completed a header block.
+ */
+void Webserver::finishCgiOutput(Client &client)
+{
+	Response &res = client.responses.back();
+	if (res.streaming)
+		HttpResponse::endCgiResponse(res);
+	else
+		HttpResponse::buildCgiResponse(res, client.cgi_output_buffer);
+	res.streaming = false;
+	res.ready = true;
+	client.is_cgi_active = false;
+	processPipeline(client.fd);
+}
+
+/**
+ * @brief The script or backend failed: answer with 'response', or cut the
+ * connection if the status line already went out.
+ */
+void Webserver::abortCgiOutput(Client &client, const char *response)
+{
+	Response &res = client.responses.back();
+	if (res.streaming)
+	{
+		// Closing early is the only way left to signal a truncated body
+		res.streaming = false;
+		res.close_after = true;
+		client.closing = true;
+	}
+	else
+		res.out.append(response);
+	res.ready = true;
+	client.is_cgi_active = false;
+	std::string().swap(client.cgi_output_buffer);
+	processPipeline(client.fd);
+}
+
+/**
+ * @brief Stop reading the script while its client lags behind.
+ *
+ * The output then waits in the pipe and the script blocks on write(), so a
+ * slow reader costs at most CGI_OUTPUT_HIGH_WATER bytes of memory. The CGI
+ * timer is off meanwhile: the script is waiting on us, not idle.
+ */
+void Webserver::updateCgiEvents(Client &client)
+{
+	// FastCGI shares its connection between clients, it is never paused
+	if (!client.is_cgi_active || !client.fastcgi_pass.empty() || client.cgi_pipe_out == -1)
+		return;
+	bool paused = client.responses.back().out.bufferedBytes() >= CGI_OUTPUT_HIGH_WATER;
+	if (paused == client.cgi_paused)
+		return;
+	client.cgi_paused = paused;
+	_loop->modify(client.cgi_pipe_out, paused ? 0 : EVENT_READ);
+	if (paused)
+		_timers.cancel(client.cgi_pipe_out);
+	else
+		_timers.arm(client.cgi_pipe_out, client.cgi_timeout_ms);
+}
+
+/**
+ * @brief Feed the request body to the script as fast as it reads stdin.
+ */
+void Webserver::handleCgiWrite(int cgi_fd)
+{
+	Client &client = _clients[_fd_table[cgi_fd].owner];
+	ssize_t written = write(cgi_fd, client.cgi_input.data() + client.cgi_input_pos,
+							client.cgi_input.size() - client.cgi_input_pos);
+	// Pipe full: the script has not read enough yet, wait for the next write event
+	if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return;
+	if (written > 0)
+		client.cgi_input_pos += written;
+	// Done, or the script closed stdin (EPIPE): either way it gets EOF
+	if (written <= 0 || client.cgi_input_pos == client.cgi_input.size())
+		closeCgiInput(client);
+}
+
+void Webserver::closeCgiInput(Client &client)
+{
+	if (client.cgi_pipe_in == -1)
+		return;
+	unregisterFd(client.cgi_pipe_in);
+	close(client.cgi_pipe_in);
+	client.cgi_pipe_in = -1;
+	std::string().swap(client.cgi_input);
+	client.cgi_input_pos = 0;
+}
+
+/* ************************************************************************** */
+/*                                  FastCGI                                   */
+/* ************************************************************************** */
+
+void Webserver::startFastCgi(int client_fd)
+{
+	if (!assignFastCgi(client_fd))
+		_fastcgi_waiting.push_back(client_fd);
+}
+
+/**
+ * @brief Begin the client's request on a pooled connection with room, or a new one.
+ * @return false if the backend is at fastcgi_connections and the client must wait.
+ */
+bool Webserver::assignFastCgi(int client_fd)
+{
+	Client &client = _clients[client_fd];
+	FastCgiConnection *conn = NULL;
+	size_t open_conns = 0;
+	for (std::map<int, FastCgiConnection>::iterator it = _fastcgi.begin(); it != _fastcgi.end() && !conn; ++it)
+	{
+		if (it->second.backend != client.fastcgi_pass)
+			continue;
+		++open_conns;
+		if (it->second.hasRoom())
+			conn = &it->second;
+	}
+
+	if (!conn)
+	{
+		if (open_conns >= _fastcgi_max_conns)
+			return false;
+		int fd = FastCgiConnection::connectTo(client.fastcgi_pass);
+		if (fd < 0)
 		{
-			if (it->fd == cgi_fd)
+			perror("fastcgi connect");
+			if (client.fastcgi_body.fd != -1)
+				close(client.fastcgi_body.fd);
+			client.fastcgi_body = FastCgiBody();
+			client.fastcgi_pass.clear();
+			abortCgiOutput(client, "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n");
+			return true;
+		}
+		conn = &_fastcgi[fd];
+		conn->fd = fd;
+		conn->backend = client.fastcgi_pass;
+		conn->queryValues();
+		registerFd(fd, FD_FASTCGI, -1, EVENT_READ | EVENT_WRITE);
+	}
+
+	if (conn->requests.empty() || client.cgi_timeout_ms > conn->timeout_ms)
+		conn->timeout_ms = client.cgi_timeout_ms;
+	client.fastcgi_fd = conn->fd;
+	client.fastcgi_id = conn->begin(client_fd, client.fastcgi_params, client.fastcgi_body);
+	client.fastcgi_params.clear();
+	_timers.arm(conn->fd, conn->timeout_ms);
+	updateFastCgiEvents(conn->fd);
+	return true;
+}
+
+void Webserver::updateFastCgiEvents(int fd)
+{
+	FastCgiConnection &conn = _fastcgi[fd];
+	int events = EVENT_READ;
+	if (!conn.connected || conn.hasOutput())
+		events |= EVENT_WRITE;
+	_loop->modify(fd, events);
+}
+
+void Webserver::handleFastCgiEvent(int fd, int events)
+{
+	FastCgiConnection &conn = _fastcgi[fd];
+
+	// 1. Completion of the non-blocking connect()
+	if (!conn.connected)
+	{
+		if (!(events & (EVENT_WRITE | EVENT_ERROR)))
+			return;
+		int err = 0;
+		socklen_t len = sizeof(err);
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)
+		{
+			LOG(LEVEL_ERROR, "FastCGI connect to " << conn.backend << " failed: " << strerror(err));
+			closeFastCgi(fd, "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n");
+			return;
+		}
+		conn.connected = true;
+	}
+
+	// 2. Records from the backend, routed by request id
+	if (events & (EVENT_READ | EVENT_ERROR))
+	{
+		std::vector<FastCgiRecord> records;
+		if (!conn.receive(records))
+		{
+			closeFastCgi(fd, "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n");
+			return;
+		}
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			const FastCgiRecord &record = records[i];
+			if (record.type == FCGI_GET_VALUES_RESULT)
 			{
-				_fds.erase(it);
-				break;
+				conn.applyValues(record.content);
+				continue;
 			}
+			std::map<unsigned short, FastCgiRequest>::iterator req = conn.requests.find(record.request_id);
+			if (req == conn.requests.end())
+				continue;
+			if (record.type == FCGI_STDOUT && req->second.client_fd != -1)
+				streamCgiOutput(_clients[req->second.client_fd], record.content.data(), record.content.size());
+			else if (record.type == FCGI_STDERR)
+				LOG(LEVEL_WARN, "FastCGI stderr: " << record.content);
+			else if (record.type == FCGI_END_REQUEST)
+				finishFastCgi(conn, record);
 		}
-		_cgi_fd_to_client_fd.erase(cgi_fd);
+	}
+
+	// 3. Pending records and request bodies
+	if ((events & EVENT_WRITE) && !conn.flush())
+	{
+		closeFastCgi(fd, "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n");
+		return;
+	}
+
+	// The backend is reading or answering: restart its deadline
+	if (conn.requests.empty())
+		_timers.cancel(fd);
+	else
+		_timers.arm(fd, conn.timeout_ms);
+	updateFastCgiEvents(fd);
+	dispatchFastCgiWaiting();
+}
 
-		waitpid(_clients[client_fd].cgi_pid, NULL, 0); // Reap zombie
+/**
+ * @brief FCGI_END_REQUEST: the end of the client's response.
+ */
+void Webserver::finishFastCgi(FastCgiConnection &conn, const FastCgiRecord &record)
+{
+	int client_fd = conn.requests[record.request_id].client_fd;
+	// protocolStatus other than FCGI_REQUEST_COMPLETE, e.g. FCGI_CANT_MPX_CONN
+	bool complete = record.content.size() < 5 || record.content[4] == 0;
+	if (!complete)
+		conn.max_requests = 1;
+	conn.finish(record.request_id);
+	if (client_fd == -1)
+		return; // Aborted, the client is gone
 
-		std::string response = HttpResponse::buildCgiResponse(_clients[client_fd].cgi_output_buffer);
-		_clients[client_fd].response_buffer = response;
-		_clients[client_fd].is_ready_to_write = true;
-		_clients[client_fd].is_cgi_active = false;
-		std::cout << "CGI Finished. Response built." << std::endl;
+	Client &client = _clients[client_fd];
+	client.fastcgi_fd = -1;
+	client.fastcgi_pass.clear();
+	if (complete)
+		finishCgiOutput(client);
+	else
+		abortCgiOutput(client, "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n");
+}
 
-		return false; // FD removed
+/**
+ * @brief Drop a backend connection, answering its in-flight requests with 'response'
+ * (or cutting those whose response already started).
+ */
+void Webserver::closeFastCgi(int fd, const char *response)
+{
+	std::vector<int> clients;
+	FastCgiConnection &conn = _fastcgi[fd];
+	for (std::map<unsigned short, FastCgiRequest>::iterator it = conn.requests.begin(); it != conn.requests.end(); ++it)
+	{
+		if (it->second.client_fd != -1)
+			clients.push_back(it->second.client_fd);
+	}
+	conn.release();
+	unregisterFd(fd);
+	close(fd);
+	_fastcgi.erase(fd);
+
+	for (size_t i = 0; i < clients.size(); ++i)
+	{
+		Client &client = _clients[clients[i]];
+		client.fastcgi_fd = -1;
+		client.fastcgi_pass.clear();
+		abortCgiOutput(client, response);
+	}
+	dispatchFastCgiWaiting();
+}
+
+/**
+ * @brief Give waiting clients the connections (or room) that just freed up, in order.
+ */
+void Webserver::dispatchFastCgiWaiting()
+{
+	for (size_t n = _fastcgi_waiting.size(); n > 0 && !_fastcgi_waiting.empty(); --n)
+	{
+		int client_fd = _fastcgi_waiting.front();
+		_fastcgi_waiting.pop_front();
+		if (!assignFastCgi(client_fd))
+			_fastcgi_waiting.push_back(client_fd);
 	}
 }
 
 void Webserver::handleClientWrite(int client_fd)
 {
-	if (_clients[client_fd].is_ready_to_write && !_clients[client_fd].response_buffer.empty())
+	Client &client = _clients[client_fd];
+	while (!client.responses.empty() && client.responses.front().ready)
 	{
-		std::string &response = _clients[client_fd].response_buffer;
-		int bytes_sent = send(client_fd, response.c_str(), response.size(), 0);
+		Response &res = client.responses.front();
+		if (res.status == 0)
+		{
+			// Head complete and unsent: announce how the connection continues
+			res.status = statusCode(res.out);
+			if (res.status != 0 && res.close_after)
+				res.out.insertAfterStatusLine("Connection: close\r\n");
+			else if (res.status != 0 && res.http10)
+				res.out.insertAfterStatusLine("Connection: keep-alive\r\n");
+		}
+
+		// 1. Memory segments with writev(), file ranges with sendfile()
+		unsigned long long sent = res.out.sentBytes();
+		OutputQueue::FlushStatus status = res.out.flush(client_fd);
+		_metrics->stats().bytes_out += res.out.sentBytes() - sent;
+		if (status == OutputQueue::FLUSH_SHORT || status == OutputQueue::FLUSH_ERROR)
+		{
+			// File shrank under us or the peer is gone: the response cannot be completed
+			closeClient(client_fd);
+			return;
+		}
+		if (status == OutputQueue::FLUSH_AGAIN)
+		{
+			updateClientTimer(client, true);
+			return; // Socket buffer full, wait for the next write event
+		}
 
-		if (bytes_sent > 0)
-			response.erase(0, bytes_sent);
+		// 2. Caught up with a CGI stream: read more of it, wait for the rest
+		if (res.streaming)
+		{
+			updateCgiEvents(client);
+			break;
+		}
 
-		if (response.empty())
+		// 3. Fully sent: move on to the next pipelined response
+		logResponse(res);
+		bool close_after = res.close_after;
+		res.closeFile();
+		client.responses.pop_front();
+		LOG_DEBUG("Response sent to client " << client_fd);
+		if (close_after)
 		{
-			_clients[client_fd].is_ready_to_write = false;
-			std::cout << "Response fully sent." << std::endl;
+			closeClient(client_fd);
+			return;
 		}
 	}
+	// Room in the pipeline again: answer requests that were held back
+	processPipeline(client_fd);
 }
 
 void Webserver::acceptConnection(int server_fd)
 {
+	// 1. At worker_connections: leave the connection queued in the backlog
+	if (_clients.size() >= _worker_connections)
+	{
+		// Only worth a warning when no idle connection can make room
+		if (_clients.oldestParked() == -1)
+			LOG(LEVEL_WARN, "worker_connections reached, no idle connection to close");
+		pauseAccept(_worker_connections);
+		return;
+	}
+
 	struct sockaddr_in client_addr;
 	socklen_t client_len = sizeof(client_addr);
 	int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len);
 
 	if (client_fd < 0)
 	{
-		perror("accept");
+		// 2. Out of descriptors: the listener would stay readable and spin
+		if (errno == EMFILE || errno == ENFILE)
+		{
+			LOG(LEVEL_WARN, "accept: " << std::strerror(errno) << " at " << _clients.size() << " connections");
+			pauseAccept(_clients.size());
+			_timers.arm(server_fd, ACCEPT_RETRY_MS);
+		}
+		else
+			perror("accept");
 		return;
 	}
+	_metrics->stats().connections_accepted++;
 	if (fcntl(client_fd, F_SETFL, O_NONBLOCK) < 0)
 	{
 		perror("fcntl client");
 		close(client_fd);
 		return;
 	}
+	// A header followed by a sendfile() body must not wait for the delayed ACK (Nagle)
+	int nodelay = 1;
+	if (setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) < 0)
+		perror("setsockopt TCP_NODELAY");
 
-	struct pollfd pfd;
-	pfd.fd = client_fd;
-	pfd.events = POLLIN | POLLOUT;
-	pfd.revents = 0;
-	_fds.push_back(pfd);
+	Client &new_client = _clients.open(client_fd);
+	new_client.remote_addr = client_addr.sin_addr;
+	new_client.listening_port = _fd_table[server_fd].owner;
+	new_client.server = _router.findServer(new_client.listening_port, "");
+	// The first request gets the header timeout, even before its first byte
+	new_client.timer_phase = TIMER_HEADER;
+	registerFd(client_fd, FD_CLIENT, -1, EVENT_READ);
+	_timers.arm(client_fd, new_client.server->client_header_timeout * 1000UL);
+	_metrics->stats().connections_handled++;
+	_metrics->stats().connections_active++;
 
-	Client new_client;
-	new_client.fd = client_fd;
-	new_client.listening_port = _server_fd_to_port[server_fd];
-	_clients[client_fd] = new_client;
+	LOG_DEBUG("New connection " << client_fd);
+}
+
+/**
+ * @brief Stop watching the listeners until fewer than 'resume_below' clients
+ * are open; pending connections wait in the kernel backlog meanwhile.
+ * After EMFILE/ENFILE it is the open count itself: any close frees a descriptor.
+ */
+void Webserver::pauseAccept(size_t resume_below)
+{
+	if (!_accept_paused)
+	{
+		for (size_t i = 0; i < _listeners.size(); ++i)
+			_loop->modify(_listeners[i], 0);
+	}
+	_accept_paused = true;
+	_accept_resume_below = resume_below;
+}
+
+void Webserver::resumeAccept()
+{
+	if (!_accept_paused)
+		return;
+	LOG_DEBUG("Accepting resumed at " << _clients.size() << " connections");
+	for (size_t i = 0; i < _listeners.size(); ++i)
+	{
+		_timers.cancel(_listeners[i]);
+		_loop->modify(_listeners[i], EVENT_READ);
+	}
+	_accept_paused = false;
+}
 
-	std::cout << "New connection: " << client_fd << std::endl;
-}
\ No newline at end of file
+/**
+ * @brief While accepting is paused, make room by closing the connections
+ * idle the longest, and accept again once there is room.
+ *
+ * A whole batch is closed, so the next connections are accepted without
+ * pausing again. Runs after an event batch: no pending event refers to a
+ * closed fd.
+ */
+void Webserver::relieveAccept()
+{
+	// Without idle connections, wait for a busy one to finish
+	int fd;
+	for (size_t reaped = 0; reaped < REAP_BATCH && (fd = _clients.oldestParked()) != -1; ++reaped)
+	{
+		closeClient(fd);
+		_metrics->stats().connections_reaped++;
+	}
+	if (_clients.size() < _accept_resume_below)
+		resumeAccept();
+}
@@ -8,12 +8,15 @@
 
 #include "../includes/Webserver.hpp"
 #include "../includes/Config.hpp" // Include your new parser
+#include "../includes/Master.hpp"
+#include <csignal>
 
 /**
  * @brief Main entry point for the web server application.
  *
  * This function parses the configuration file provided as a command-line argument,
  * initializes the web server with the parsed configuration, and starts the server loop.
+ * With `worker_processes` > 1 a master process forks and supervises that many workers.
  *
  * @param argc Argument count
  * @param argv Argument vector
@@ -32,15 +35,39 @@ int main(int argc, char **argv)
 		// 1. Parse the config file first
 		ConfigParser parser;
 		std::vector<ServerConfig> configs = parser.parse(argv[1]);
+		Log::setLevel(parser.getGlobalConfig().log_level);
 		// In main.cpp, after parser.parse(argv[1])
 		if (configs.empty())
 		{
 			std::cerr << "Error: No valid server blocks found in configuration file." << std::endl;
 			return 1;
 		}
+		// A peer closing mid-send must not kill the process
+		signal(SIGPIPE, SIG_IGN);
+
+		int workers = parser.getGlobalConfig().worker_processes;
+#ifndef SO_REUSEPORT
+		if (workers > 1)
+		{
+			std::cerr << "Warning: SO_REUSEPORT unsupported, running a single process" << std::endl;
+			workers = 1;
+		}
+#endif
+		// Counters shared by the workers, so they must exist before the fork
+		size_t locations = 0;
+		for (size_t i = 0; i < configs.size(); ++i)
+			locations += configs[i].locations.size();
+		Metrics metrics;
+		metrics.allocate(workers, locations);
+		if (workers > 1)
+		{
+			Master master(configs, parser.getGlobalConfig(), metrics, workers);
+			master.run();
+			return 0;
+		}
 		// 2. Pass the configurations to the server
 		Webserver server;
-		server.init(configs);
+		server.init(configs, parser.getGlobalConfig(), metrics);
 		server.run();
 	}
 	catch (const std::exception &e)